@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "slab.h"
+#include "rto.h"
+#include "abp.h"
+
+/* ******************************************************************
+   Alternating Bit protocol.  Adapted from J.F.Kurose
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2
+
+   Network properties:
+   - one way network delay averages five time units (longer if there
+   are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+   or lost, according to user-defined probabilities
+   - packets will be delivered in the order in which they were sent
+   (although some can be lost).
+
+   Modifications:
+   - stop and wait with one bit of sequence number, the window 1 baseline
+   of GBN and SR.  The state is as small as it gets: the packet awaiting
+   an ACK is in the pool only while there is one, and the congestion
+   window is left out, as it can never be above 1.
+**********************************************************************/
+
+#define RTT 16.0      /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#define SEQSPACE 2    /* sequence numbers alternate between 0 and 1 */
+#define NOTINUSE (-1) /* used to fill header fields that are not being used */
+
+/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
+   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
+   original checksum.  This procedure must generate a different checksum to the original if
+   the packet is corrupted.
+*/
+static int ComputeChecksum(struct pkt packet)
+{
+  int checksum = 0;
+  int i;
+
+  checksum = packet.seqnum;
+  checksum += packet.acknum;
+  for (i = 0; i < 20; i++)
+    checksum += (int)(packet.payload[i]);
+
+  return checksum;
+}
+
+static bool IsCorrupted(struct pkt packet)
+{
+  if (packet.checksum == ComputeChecksum(packet))
+    return (false);
+  else
+    return (true);
+}
+
+/********* Sender (A) variables and functions ************/
+
+/* sender state of one connection, found through Astate */
+struct sender
+{
+  slabref buffer;              /* the packet waiting for ACK, 0 if there is none */
+  unsigned char A_nextseqnum;  /* the sequence number of the next packet */
+  struct rto rto;              /* retransmission timeout */
+};
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void A_output(struct msg message)
+{
+  struct sender *s = Astate;
+  struct pkt sendpkt;
+  int i;
+
+  /* if not blocked waiting on ACK */
+  if (s->buffer == 0)
+  {
+    if (TRACE > 1)
+      printf("----A: New message arrives, no packet awaits an ACK, send new messge to layer3!\n");
+
+    /* create packet */
+    sendpkt.seqnum = s->A_nextseqnum;
+    sendpkt.acknum = NOTINUSE;
+    for (i = 0; i < 20; i++)
+      sendpkt.payload[i] = message.data[i];
+    sendpkt.flags = ecn ? ECT : 0;
+    sendpkt.checksum = ComputeChecksum(sendpkt);
+
+    /* keep it for resending, in a block from the pool */
+    s->buffer = slabget(sizeof(struct pkt));
+    *(struct pkt *)slabptr(s->buffer) = sendpkt;
+
+    /* send out packet */
+    if (TRACE > 0)
+      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+    tolayer3(A, sendpkt);
+    rtosent(&s->rto, sendpkt.seqnum);
+    starttimer(A, rtotimeout(&s->rto));
+
+    /* get next sequence number, wrap back to 0 */
+    s->A_nextseqnum = (s->A_nextseqnum + 1) % SEQSPACE;
+  }
+  /* if blocked, a packet still awaits its ACK */
+  else
+  {
+    if (TRACE > 0)
+      printf("----A: New message arrives, send window is full\n");
+    connstats->window_full++;
+  }
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   In this practical this will always be an ACK as B never sends data.
+*/
+static void A_input(struct pkt packet)
+{
+  struct sender *s = Astate;
+
+  /* if received ACK is not corrupted */
+  if (!IsCorrupted(packet))
+  {
+    if (TRACE > 0)
+      printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
+    connstats->total_ACKs_received++;
+
+    /* an ACK of the packet outstanding, the one before the next */
+    if (s->buffer != 0 && packet.acknum == (s->A_nextseqnum + 1) % SEQSPACE)
+    {
+      if (TRACE > 0)
+        printf("----A: ACK %d is not a duplicate\n", packet.acknum);
+      connstats->new_ACKs++;
+      rtoacked(&s->rto);
+      stoptimer(A);
+      slabput(s->buffer, sizeof(struct pkt));
+      s->buffer = 0;
+    }
+    else if (TRACE > 0)
+      printf("----A: duplicate ACK received, do nothing!\n");
+  }
+  else if (TRACE > 0)
+    printf("----A: corrupted ACK is received, do nothing!\n");
+}
+
+/* called when A's timer goes off */
+static void A_timerinterrupt(void)
+{
+  struct sender *s = Astate;
+  struct pkt *packet;
+
+  if (TRACE > 0)
+    printf("----A: time out,resend packets!\n");
+  rtoexpired(&s->rto);
+  if (s->buffer == 0)
+    return;
+
+  packet = slabptr(s->buffer);
+  if (TRACE > 0)
+    printf("---A: resending packet %d\n", packet->seqnum);
+  tolayer3(A, *packet);
+  connstats->packets_resent++;
+  starttimer(A, rtotimeout(&s->rto));
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+static void A_init(void)
+{
+  struct sender *s = Astate;
+
+  s->A_nextseqnum = 0; /* A starts with seq num 0, do not change this */
+  s->buffer = 0;       /* no buffer until there is something to send */
+  rtoinit(&s->rto, rto_initial > 0 ? rto_initial : RTT, adaptive_rto);
+}
+
+/********* Receiver (B)  variables and procedures ************/
+
+/* receiver state of one connection, found through Bstate */
+struct receiver
+{
+  unsigned char expectedseqnum; /* the sequence number expected next by the receiver */
+};
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+static void B_input(struct pkt packet)
+{
+  struct receiver *r = Bstate;
+  struct pkt sendpkt;
+  int i;
+
+  /* if not corrupted and received packet is in order */
+  if ((!IsCorrupted(packet)) && (packet.seqnum == r->expectedseqnum))
+  {
+    if (TRACE > 0)
+      printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
+    connstats->packets_received++;
+
+    /* deliver to receiving application */
+    tolayer5(B, packet.payload);
+
+    /* send an ACK for the received packet */
+    sendpkt.acknum = r->expectedseqnum;
+
+    /* update state variables */
+    r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+  }
+  else
+  {
+    /* packet is corrupted or a duplicate: ACK the last one again */
+    if (TRACE > 0)
+      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
+    sendpkt.acknum = (r->expectedseqnum + 1) % SEQSPACE;
+  }
+
+  /* create packet, echoing a congestion mark */
+  sendpkt.seqnum = NOTINUSE;
+  sendpkt.flags = (packet.flags & CE) ? ECE : 0;
+
+  /* we don't have any data to send.  fill payload with 0's */
+  for (i = 0; i < 20; i++)
+    sendpkt.payload[i] = '0';
+
+  /* computer checksum */
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+
+  /* send out packet */
+  tolayer3(B, sendpkt);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+static void B_init(void)
+{
+  struct receiver *r = Bstate;
+
+  r->expectedseqnum = 0;
+}
+
+/******************************************************************************
+ * The following functions need be completed only for bi-directional messages *
+ *****************************************************************************/
+
+/* Note that with simplex transfer from a-to-B, there is no B_output() */
+static void B_output(struct msg message)
+{
+}
+
+/* called when B's timer goes off */
+static void B_timerinterrupt(void)
+{
+}
+
+const struct protocol abp_protocol = {
+    "abp", sizeof(struct sender), sizeof(struct receiver), 1, RTT, STOPWAIT, 0,
+    A_init, B_init, A_input, B_input, A_output, B_output, A_timerinterrupt, B_timerinterrupt, NULL, NULL};
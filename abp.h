@@ -0,0 +1,2 @@
+/* Alternating Bit protocol entities */
+extern const struct protocol abp_protocol;
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+/* ******************************************************************
+   Result cache.  Entries are named by their key in hex.  cacheput()
+   writes to a temporary name that holds the process id, so no two
+   writers share a file, and rename() swaps it in whole; a reader sees
+   either the old entry, the new one or none.  Entries of the wrong size
+   are treated as missing.
+**********************************************************************/
+
+#define NAMELEN 16 /* hex digits of a key */
+
+static char path[4096]; /* the directory, then the file being worked on */
+static size_t dirlen;
+
+static char *entry(unsigned long long key)
+{
+  snprintf(path + dirlen, sizeof(path) - dirlen, "/%016llx", key);
+  return path;
+}
+
+int cacheopen(const char *dir)
+{
+  struct stat st;
+
+  dirlen = strlen(dir);
+  if (dirlen + NAMELEN + 32 > sizeof(path))
+    return 0;
+  memcpy(path, dir, dirlen + 1);
+  if (mkdir(path, 0777) != 0 && errno != EEXIST)
+    return 0;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode) && access(path, R_OK | W_OK | X_OK) == 0;
+}
+
+int cacheget(unsigned long long key, void *buf, size_t n)
+{
+  char extra;
+  ssize_t got;
+  size_t have = 0;
+  int fd = open(entry(key), O_RDONLY);
+
+  if (fd < 0)
+    return 0;
+  while (have < n && (got = read(fd, (char *)buf + have, n - have)) > 0)
+    have += got;
+  if (have == n && read(fd, &extra, 1) != 0)
+    have = 0; /* longer than a result */
+  close(fd);
+  return have == n;
+}
+
+void cacheput(unsigned long long key, const void *buf, size_t n)
+{
+  char tmp[sizeof(path) + 24];
+  ssize_t put;
+  size_t done = 0;
+  int fd;
+
+  snprintf(tmp, sizeof(tmp), "%s.%ld", entry(key), (long)getpid());
+  if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    return; /* the run goes uncached */
+  while (done < n && (put = write(fd, (const char *)buf + done, n - done)) > 0)
+    done += put;
+  if (close(fd) != 0 || done < n || rename(tmp, path) != 0)
+    unlink(tmp);
+}
+
+/* an entry, or one being written: the key in hex, then maybe a dot */
+static int isentry(const char *name)
+{
+  int i;
+
+  for (i = 0; i < NAMELEN; i++)
+    if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f')))
+      return 0;
+  return name[NAMELEN] == '\0' || name[NAMELEN] == '.';
+}
+
+int cacheclear(void)
+{
+  struct dirent *d;
+  DIR *dir;
+  int n = 0;
+
+  path[dirlen] = '\0';
+  if ((dir = opendir(path)) == NULL)
+    return 0;
+  while ((d = readdir(dir)) != NULL)
+    if (isentry(d->d_name))
+    {
+      snprintf(path + dirlen, sizeof(path) - dirlen, "/%s", d->d_name);
+      n += unlink(path) == 0;
+    }
+  closedir(dir);
+  return n;
+}
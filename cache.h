@@ -0,0 +1,17 @@
+/* A cache of the results of runs on disk: a directory holding a file per
+   result, named by a 64-bit hash of everything the run depends on.  An
+   entry is written under a name of its own and then renamed into place,
+   so workers writing at once never leave, or read, a partial entry. */
+
+#include <stddef.h>
+
+/* use the directory dir, making it if need be; 0 if it can't be used */
+extern int cacheopen(const char *dir);
+
+/* copy the entry for key, of exactly n bytes, to buf; 0 if there is none */
+extern int cacheget(unsigned long long key, void *buf, size_t n);
+
+extern void cacheput(unsigned long long key, const void *buf, size_t n);
+
+/* remove every entry, as when the protocols have changed; returns how many */
+extern int cacheclear(void);
@@ -0,0 +1,53 @@
+#include "emulator.h"
+#include "cc.h"
+
+void ccinit(struct cwnd *w, int max, int on)
+{
+  w->max = max;
+  w->on = on;
+  w->cwnd = on ? 1 : max;
+  w->ssthresh = max;
+  w->acked = max; /* the first mark always counts */
+}
+
+int ccwindow(struct cwnd *w)
+{
+  return w->cwnd < 1 ? 1 : (int)w->cwnd;
+}
+
+void ccacked(struct cwnd *w, int n)
+{
+  if (!w->on)
+    return;
+  if (w->acked < 65535 - n)
+    w->acked += n;
+  while (n-- > 0)
+    w->cwnd += w->cwnd < w->ssthresh ? 1 : 1 / w->cwnd;
+  if (w->cwnd > w->max)
+    w->cwnd = w->max;
+}
+
+void ccmarked(struct cwnd *w)
+{
+  if (!w->on || w->acked < w->cwnd)
+    return;
+  cchalve(w);
+}
+
+void cchalve(struct cwnd *w)
+{
+  if (!w->on)
+    return;
+  w->ssthresh = w->cwnd / 2 < 1 ? 1 : w->cwnd / 2;
+  w->cwnd = w->ssthresh;
+  w->acked = 0;
+}
+
+void cctimeout(struct cwnd *w)
+{
+  if (!w->on)
+    return;
+  w->ssthresh = w->cwnd / 2 < 1 ? 1 : w->cwnd / 2;
+  w->cwnd = 1;
+  w->acked = 0;
+}
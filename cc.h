@@ -0,0 +1,32 @@
+/* Congestion window of a sender, in packets.  It stays at the protocol's
+   window size unless it is on, as it is for every sender when
+   congestion_control is set; then it grows by one packet per ACKed packet
+   up to ssthresh and by one per window after that, is halved when an ACK
+   echoes an ECN mark (at most once per window) or the sender finds a loss
+   by other means, and falls back to one packet on a timeout. */
+
+struct cwnd
+{
+  float cwnd;             /* packets that may be awaiting an ACK */
+  float ssthresh;         /* slow start threshold */
+  unsigned short acked;   /* packets ACKed since the window was last cut */
+  unsigned char max;      /* the protocol's window size */
+  unsigned char on;       /* set when it follows congestion */
+};
+
+extern void ccinit(struct cwnd *w, int max, int on);
+
+/* packets that may be awaiting an ACK now */
+extern int ccwindow(struct cwnd *w);
+
+/* n more packets were ACKed */
+extern void ccacked(struct cwnd *w, int n);
+
+/* an ACK echoed a congestion mark */
+extern void ccmarked(struct cwnd *w);
+
+/* a loss was found without a timeout, as by duplicate ACKs */
+extern void cchalve(struct cwnd *w);
+
+/* the timer went off */
+extern void cctimeout(struct cwnd *w);
@@ -33,69 +33,460 @@
    soon as n packets are sent.
    - fixed C style to adhere to current programming style
 
+   Modifications:
+   - N hosts joined pairwise by one-way channels carrying any number of
+   connections, each running its own GBN or SR instance with its own
+   state, timers and statistics.  Packets of all connections from one
+   host to another share the channel and are delivered in order.
+   - compact per-connection state, found through a hash table on its hosts
+   and port; buffers and events come from a shared slab pool and pending
+   events can be kept in a binary heap, for runs with a million
+   connections.
+   - incast: many senders into one receiver through a shared drop-tail
+   bottleneck queue, run with fixed and with adaptive retransmission
+   timeouts and reported per flow.
+   - routes of store-and-forward routers between hosts, each with its own
+   link rate, queue limit and drop-tail, RED or CoDel queue discipline.
+   - congestion windows in the senders, and ECN: routers mark packets
+   instead of dropping them and receivers echo the marks.
+   - sharded runs: connections that share no channel or router are run
+   by worker threads, each with its own event queue, random number
+   streams and slab pool, with the same results for any thread count.
+   - parallel runs: hosts and routers are logical processes run by worker
+   threads in conservative time windows, with the same results for any
+   thread count.  Each process draws its own random numbers, so these are
+   the results of -P 1, all processes on one thread, and not of a run
+   without -P, which draws from one stream.
+   - a FIFO event queue: the arrivals from a channel are appended to a
+   FIFO of its own, and only the first of each FIFO waits in the heap.
+   - batched arrivals: packets reaching an entity at the same instant go
+   to a protocol that takes them together in one call.  The medium can
+   round arrival times up so that packets coincide.
+   - long runs: built with -DCOUNT64 the message and packet counts are
+   64-bit, and a soak run samples memory use to show it stays flat.
+   - snapshots: the whole state of a run can be saved at a given time and
+   runs resumed from it, with new loss, corruption and arrival parameters.
+   - warm-up: the statistics can start afresh after a given time or once
+   MSER-5 finds the goodput steady, and runs can stop as soon as the
+   goodput is known closely enough.
+   - replicates: independent runs with different seeds, in child processes
+   side by side, until the confidence intervals of the goodput and of the
+   99th percentile of the packet delay are narrow enough.
+   - importance sampling: losses drawn at a biased, higher probability and
+   runs weighed by their likelihood ratio, for rare outcomes such as the
+   far tail of the delay and timeouts many times in a row.
+   - an optimizer: the protocol, window and retransmission timeout that
+   give the most goodput with the 99th percentile of the delay in bounds.
+   - a result cache: replicates, of the replicate runs and the optimizer,
+   are kept on disk by a hash of the build, the parameters and the seed,
+   and a run that was done before is answered from it.
+   - a throughput model: closed-form goodput and efficiency of
+   stop-and-wait, go-back-N and selective repeat, reported next to those
+   of the run.
+   - an alternating bit protocol, the window 1 baseline of GBN and SR.
+   - a TCP NewReno style protocol: cumulative ACKs with SACK, fast
+   retransmit and recovery, an adaptive timeout and a congestion window.
+   - loss detection by time (RACK) and tail loss probes in the selective
+   repeat senders, and a tail run that sends short bursts of messages without and with
+   them and reports the latency of the messages.
+   - a go-back-N / selective repeat hybrid that picks its recovery by the
+   timeouts it sees, and a scenario run that steps the loss probability
+   through phases and compares it with both.
+   - go-back-N receivers that hold packets out of order, run without and
+   with it to show the resends and packets it saves.
+
    ********************************************************************* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <math.h>
+#include <limits.h>
 #include "emulator.h"
+#include "event.h"
+#include "slab.h"
+#include "hash.h"
+#include "router.h"
+#include "abp.h"
 #include "gbn.h"
+#include "sr.h"
+#include "tcp.h"
+#include "hybrid.h"
+#include "cache.h"
+#include "rto.h"
+#include "rack.h"
+
+#if SIMCLOCK == FLOATCLOCK
+#define CONNSTATE 64 /* bytes of protocol state kept for A and B together */
+#else
+#define CONNSTATE 80 /* with room for the wider time in the retransmission timeouts */
+#endif
+#define MAXHOSTS (1 << 22)
+#define MAXPORTS (1 << 20) /* connections between the same two hosts */
+#define MAXLISTED 64       /* connections listed one by one in the report */
+#define MAXHOPS 32         /* routers on one route */
+#define MAXBATCH 64        /* packets handed to an entity in one call */
+#define MAXTHREADS 256
+#define SHARDSEED 9999 /* seeds the random number streams of sharded runs */
+#define SNAPMAGIC "EMUSNAP1"
+#define OBSERVE 16.0  /* time units between observations of the goodput, a round trip */
+#define MSERBATCH 5   /* observations averaged into a batch, for MSER-5 */
+#define MSERMIN 20    /* batches before the end of the warm-up is looked for */
+#define MSERMAX 4096  /* batches after which it is given up */
+#define STEADYMIN 20  /* batches after the warm-up before a run may stop early */
+#define WARMTIME 1    /* warm-up until a given time */
+#define WARMMSER 2    /* until MSER-5 finds it over */
+#define HISTOCTAVE 16 /* bins to an octave of the histogram of packet delays, */
+#define HISTBINS 512  /* from 1/16 time unit on */
+#define REPMIN 3      /* replicates before their confidence intervals are judged */
+#define REPMAX 1000   /* after which they are given up on */
+#define STREAKS 8     /* timeouts in a row that importance sampling reports the odds of, */
+#define RARESTREAK 3  /* and that it runs replicates until it knows the odds of */
+#define OPTREPS 8     /* replicates of every candidate of the optimizer, with the same seeds */
+#define LATSLOTS 32   /* messages of a connection in flight whose latency a tail run can follow */
+#define BURSTGAP 0.1  /* mean time between the messages of a burst */
+#define MAXPHASES 16  /* loss probabilities a scenario run steps through */
+#define OPTMINRTO 4.0 /* the timeouts it searches */
+#define OPTMAXRTO 64.0
+#define OPTSTEPS 12   /* steps of its golden-section search */
+#define HOPDELAY 5.5  /* mean time through an idle channel, 1 + 9/2 as tolayer3 draws it */
+#define MODELTOL 0.2  /* relative error of the throughput model beyond which a run is flagged */
+#define SOAKEVERY (1ULL << 22) /* events between the samples of a soak run */
+#define SOAKSLACK 0.01         /* part memory may grow by in a soak run and count as flat, */
+#define SOAKRSSKB 256          /* and kB the resident set may besides, for the C library's own */
+
+/* settings of a run that not every run mode takes */
+#define SETSNAPSHOT (1 << 0)  /* -W, a snapshot written */
+#define SETRESUME (1 << 1)    /* -L, a run resumed from one */
+#define SETPARALLEL (1 << 2)  /* -P */
+#define SETSHARDED (1 << 3)   /* -j */
+#define SETBIAS (1 << 4)      /* -b */
+#define SETCONNFILE (1 << 5)  /* -f */
+#define SETECN (1 << 6)       /* -E */
+#define SETBUFFERING (1 << 7) /* -G */
+#if SIMCLOCK == TICKCLOCK
+#define NEVER LLONG_MAX /* later than any event */
+#else
+#define NEVER INFINITY
+#endif
+
+/* a connection from the A entity on one host to the B entity on another,
+   three cache lines of the connection table */
+struct conn
+{
+  _Alignas(64) int id;
+  int host[2];                  /* hosts of the A and B entities */
+  int port;                     /* tells apart connections between the same hosts */
+  const struct protocol *proto; /* protocol run by both entities */
+  struct event *timer[2];       /* pending timer interrupt of A and B, if any */
+  struct stats stats;           /* statistics updated by the protocol */
+  counter nsim;                 /* number of messages from 5 to 4 so far */
+  counter nsimmax;              /* number of msgs to generate, then stop */
+  counter messages_delivered;
+  counter ntolayer3;                 /* number sent into layer 3 */
+  counter nlost;                     /* number lost in media */
+  counter ncorrupt;                  /* number corrupted by media*/
+  counter timeouts;                  /* timer interrupts at A */
+  int streak, maxstreak;             /* timeouts at A in a row without a new ACK */
+  clocktime lastdelivery;            /* time of the latest delivery to layer 5 */
+  counter ndelayed;                  /* packets that reached B */
+  double delay;                      /* the time they spent in the network */
+  union
+  {
+    struct
+    {
+      int group;              /* sharded runs: first connection of its independent group */
+      unsigned long long rng; /* and the random number state of the group, in its first connection */
+    };
+    struct
+    {
+      counter Bntolayer3; /* parallel runs: the counts above for packets sent by B, */
+      counter Bnlost;     /* kept apart while B may be run by another thread than A */
+      counter Bncorrupt;
+    };
+  };
+  _Alignas(8) char state[CONNSTATE]; /* protocol state of A, then of B */
+};
+
+/* the one-way medium from one host to another, shared by all connections */
+struct channel
+{
+  clocktime lastarrival; /* arrival time of the latest packet sent into it */
+  int nconns;          /* connections using it so far, numbers their ports */
+  unsigned int fifo;   /* of its arrivals in the event queue, 0 until made */
+  struct route *route; /* routers its packets pass after the medium, if any */
+  clocktime lastinstant;  /* arrivals rounded: the instant the latest packet arrives at, */
+  struct event *arriving; /* and its event, pending until then */
+};
+
+/* the emulator's copy of a packet in the network */
+struct netpkt
+{
+  struct pkt pkt;
+  clocktime sent;   /* when it was given to layer 3 */
+  struct pkt *next; /* arrivals rounded: the one arriving after it at the same instant */
+};
+
+/* the routers between two hosts, in the order packets pass them */
+struct route
+{
+  int nhops;
+  int hop[]; /* index in routers[] */
+};
+
+/* a logical process of parallel runs: a host, with the entities on it and
+   the channels out of it, or a router.  Processes 0 to nhosts - 1 are the
+   hosts and the routers follow. */
+struct lp
+{
+  unsigned long long rng;    /* its random number stream */
+  unsigned long long stamps; /* events it has made so far */
+};
+
+/* events posted by one thread of a parallel run to another */
+struct outbox
+{
+  struct event **ev;
+  unsigned long n, max;
+};
 
-struct event
+/* the start of a snapshot file.  It is followed by the pending events, as
+   pointers into the saved pool in the order they come out of the queue,
+   and from the page at image on by the pool's carved bytes. */
+struct snaphead
 {
-  float evtime;       /* event time */
-  int evtype;         /* event type code */
-  int eventity;       /* entity where event occurs */
-  struct pkt *pktptr; /* ptr to packet (if any) assoc w/ this event */
-  struct event *prev;
-  struct event *next;
+  char magic[8];
+  int connsize, eventsize, clock, countsize; /* of the build that made it */
+  int nhosts, nconns, nrouters;
+  int adaptive_rto, congestion_control, ecn, evqueue;
+  clocktime simtime;
+  counter nsim, nsimmax;
+  unsigned long long nevents;
+  unsigned long long rng;
+  struct conn *conns;
+  struct hashtable conntable, chantable;
+  struct router *routers;
+  const struct protocol *protocols[8]; /* where the protocols were, to tell them apart */
+  unsigned long npending;
+  long image;
+  struct slabstate slab;
 };
 
-struct event *evlist = NULL; /* the event list */
+/* what a replicate measured */
+struct replicate
+{
+  double goodput; /* messages delivered per time unit */
+  double p99;     /* delay within which 99 of 100 packets reached B */
+  double weight;  /* likelihood ratio of the run, for importance sampling */
+  int maxstreak;  /* most timeouts in a row of any sender */
+  unsigned long hist[HISTBINS]; /* packets that reached B, by their delay */
+};
+
+/* when the messages a connection's A took and B has yet to deliver were
+   taken, oldest first, in tail runs */
+struct latency
+{
+  clocktime born[LATSLOTS];
+  unsigned char first, n;
+};
+
+/* a run mode in place of the ordinary run, and the settings it takes */
+struct runmode
+{
+  int given; /* set if it was asked for */
+  int takes; /* SET... bits */
+};
 
 /* possible events: */
 #define TIMER_INTERRUPT 0
 #define FROM_LAYER5 1
 #define FROM_LAYER3 2
+#define TO_ROUTER 3   /* packet reaches the queue of a router */
+#define FROM_ROUTER 4 /* packet at the head of the queue has been sent on */
 
 #define OFF 0
 #define ON 1
 
 int TRACE = 3;
 
-/* statistics updated by GBN */
-int window_full; /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;   /* count of the number of packets resent  */
-int new_ACKs;         /* count of the number of acks correctly received */
-int packets_received; /* count of the packets received by receiver */
-
-/* statistics updated by emulator */
-static int packets_lost;
-static int packets_corrupt;
-static int packets_sent;
-static int packets_timeout;
-static int messages_delivered;
-
-static int nsim = 0;    /* number of messages from 5 to 4 so far */
-static int nsimmax = 0; /* number of msgs to generate, then stop */
-static float time = 0.000;
+/* the connection being serviced, see emulator.h */
+_Thread_local void *Astate;
+_Thread_local void *Bstate;
+_Thread_local struct stats *connstats;
+static _Thread_local struct conn *curconn;
+static _Thread_local unsigned long long *rng; /* random numbers of its group, in sharded runs */
+
+static _Thread_local counter nsim = 0; /* number of messages from 5 to 4 so far */
+static counter nsimmax = 0;            /* number of msgs to generate, then stop */
+static _Thread_local clocktime simtime = 0.000;
 static float lossprob;       /* probability that a packet is dropped  */
 static float corruptprob;    /* probability that one bit is packet is flipped */
 static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
 static float lambda;         /* arrival rate of messages from layer 5 */
-static int ntolayer3;        /* number sent into layer 3 */
-static int nlost;            /* number lost in media */
-static int ncorrupt;         /* number corrupted by media*/
+
+/* topology, set from the command line */
+static const struct protocol *protocols[] = {&abp_protocol, &gbn_protocol, &sr_protocol, &tcp_protocol, &hybrid_protocol, NULL};
+static const struct protocol *protocol = &gbn_protocol; /* default for all connections */
+static int nhosts = 2;
+static int nconns = 1;
+static const char *connfile;        /* file listing the connections, if any */
+static struct conn *conns;          /* the connection table */
+static struct hashtable conntable;  /* connections by connkey() */
+static struct hashtable chantable;  /* channels by chankey() */
+static _Thread_local unsigned long long nevents; /* events simulated so far */
+static int checkorder;              /* set to take a fingerprint of the order of events */
+static unsigned long long evorder;  /* and the fingerprint */
+static int soak;                    /* set to sample memory use as the run goes on */
+static int soaksamples;             /* samples taken so far, */
+static size_t soakbytes;            /* and the first: bytes of the pools, */
+static long soakrss;                /* and kB resident */
+static double soakstart;
+static const char *snapfile;        /* snapshot to write, if any, */
+static double snapat = -1;          /* at this time */
+static clocktime snaptime = NEVER;  /* and the same on the clock, until it is written */
+static const char *loadfile;        /* snapshot to resume from, if any */
+static unsigned long long seqrng;   /* random number stream of runs with snapshots */
+static int warmup;                  /* WARMTIME, WARMMSER or 0 for none */
+static double warmat;               /* when it ends, for WARMTIME */
+static double tolerance;            /* stop once the goodput is known to within this part of it, 0 to run on */
+static int warming;                 /* set until the warm-up is over */
+static clocktime warmedup;          /* when the statistics started */
+static double warmend;              /* where MSER-5 put the end of the warm-up */
+static int stoppedearly;
+static clocktime nextobs = NEVER;   /* time of the next observation of the goodput */
+static _Thread_local counter ndelivered; /* messages delivered, */
+static counter obsdelivered;        /* and by the last observation */
+static int batchn;                  /* observations in the batch being filled, */
+static double batchsum;             /* and their sum */
+static double series[MSERMAX];      /* means of the batches of the warm-up */
+static int nseries;
+static double steadyn, steadysum, steadysq; /* and of those after it */
+static _Thread_local unsigned long delayhist[HISTBINS]; /* packets that reached B, by their delay */
+static double repwidth;             /* replicate until the confidence intervals are narrower than this part of the means */
+static int repprocs = 1;            /* replicates run at once */
+static double lossbias;             /* importance sampling: the probability losses are drawn at, 0 for none */
+static double lostweight, keptweight; /* and the log of the likelihood ratio of a packet lost and not */
+static double logweight;            /* the log of the likelihood ratio of the run so far */
+static double delaybound;           /* optimizer: the bound on the 99th percentile of the delay, 0 for none */
+static const char *cachedir;        /* directory of the result cache, if any */
+static int invalidate;              /* set to empty it first */
+static unsigned long long buildkey; /* hash of the program and the files the runs read */
+static int ecncompare;              /* set to compare drop-based with ECN congestion signals */
+static int buffercompare;           /* set to compare go-back-N receivers discarding and holding packets */
+static int burst;                   /* tail runs: messages to a burst, 0 for none */
+static struct latency *latencies;   /* and the messages in flight of every connection */
+static double msghist[HISTBINS];    /* messages delivered, by their latency */
+static double msgsum;               /* and the sum of it */
+static int nphases;                 /* scenario runs: phases of the messages, 0 for none */
+static double losses[MAXPHASES];    /* the loss probability of each */
+static int phase;                   /* the one the messages from A are in */
+static clocktime phasestart[MAXPHASES]; /* when each started */
+static counter phasedelivered[MAXPHASES]; /* messages delivered in it */
+static counter phaseswitches[MAXPHASES];  /* and the hybrid's mode switches by its start */
+static int cachehits, cacheruns;    /* replicates answered from it, of those asked for */
+static const char *topofile;        /* file listing the routers and routes, if any */
+static struct router *routers;      /* the routers */
+static int nrouters;
+static int discipline = DROPTAIL;   /* of routers not given one */
+static int incast;                  /* senders into host 0, 0 for none */
+static double bottleneckrate = 1.0; /* packets per time unit of the router in front of it */
+static int bottlenecklimit = 16;    /* and its queue length */
+static double quantum;              /* arrivals rounded up to a multiple of this, so they coincide, 0 to leave them */
+static int unbatched;               /* set to hand packets over one at a time even to protocols that take batches */
+
+static int nthreads;                /* worker threads, 0 to run unsharded */
+static int *shardconns;             /* connections by thread, */
+static int shardstart[MAXTHREADS + 1]; /* those of thread t from shardstart[t] on */
+static size_t shardbytes;           /* memory used by the threads */
+
+static int pdes;                    /* threads of the parallel engine, 0 when not in use */
+static struct lp *lps;              /* its logical processes */
+static int nlps;
+static double lookahead;            /* least time from an event to one it makes in another process */
+static struct outbox *outboxes;     /* those of thread s to thread d in outboxes[s * pdes + d] */
+static clocktime *nexttime;         /* time of the next event of every thread */
+static pthread_barrier_t windowbarrier;
+static unsigned long windows;       /* time windows simulated */
+static _Thread_local int curlp;     /* the logical process being run */
+static _Thread_local int curthread; /* and the thread running it */
+static _Thread_local clocktime horizon = NEVER; /* events from then on wait for the next window */
+
+int adaptive_rto = 0;
+int rack = 0;
+int gbn_buffering = 0;
+int congestion_control = 0;
+int window_limit = 0;
+double rto_initial = 0.0;
+int ecn = 0;
 
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
 /* isolate all random number generation in one location.  We assume that the*/
 /* system-supplied rand() function return an int in therange [0,mmm]        */
 /****************************************************************************/
+/* next number of a splitmix64 stream */
+unsigned long long nextrandom(unsigned long long *state)
+{
+  unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* mix v into the fingerprint h */
+void fold(unsigned long long *h, unsigned long long v)
+{
+  *h ^= v;
+  *h = nextrandom(h);
+}
+
+/* mix n bytes at p into the fingerprint h */
+void foldbytes(unsigned long long *h, const void *p, size_t n)
+{
+  unsigned long long v;
+
+  for (; n >= sizeof(v); n -= sizeof(v), p = (const char *)p + sizeof(v))
+  {
+    memcpy(&v, p, sizeof(v));
+    fold(h, v);
+  }
+  v = 0;
+  memcpy(&v, p, n);
+  fold(h, v ^ (unsigned long long)n << 56);
+}
+
+/* mix the contents of the named file into h, if there is one */
+void foldfile(unsigned long long *h, const char *name)
+{
+  char buf[1 << 16];
+  ssize_t n;
+  int fd;
+
+  if (name == NULL)
+    return;
+  if ((fd = open(name, O_RDONLY)) < 0)
+  {
+    fold(h, 0); /* the run will report it */
+    return;
+  }
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    foldbytes(h, buf, n);
+  close(fd);
+}
+
 double jimsrand(void)
 {
   double mmm = RAND_MAX; /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
   double x;
-  x = rand() / mmm; /* x should be uniform in [0,1] */
+  if (rng != NULL) /* sharded runs: the stream of the connection's group */
+    x = (nextrandom(rng) >> 11) / 9007199254740992.0;
+  else
+    x = rand() / mmm; /* x should be uniform in [0,1] */
   if (TRACE > 3)
     printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
   return (x);
@@ -105,50 +496,88 @@ double jimsrand(void)
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
+int eventlp(struct event *p); /* see below */
+
+/* the thread of the parallel engine running a logical process */
+int lpthread(int lp)
+{
+  return (int)((long long)lp * pdes / nlps);
+}
+
+void post(struct outbox *o, struct event *p)
+{
+  if (o->n == o->max)
+  {
+    o->max = o->max ? 2 * o->max : 256;
+    o->ev = realloc(o->ev, o->max * sizeof(struct event *));
+    if (o->ev == NULL)
+    {
+      printf("memory allocation for posted events failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  o->ev[o->n++] = p;
+}
+
 void insertevent(struct event *p)
 {
-  struct event *q, *qold;
+  int t;
 
   if (TRACE > 2)
   {
-    printf("            INSERTEVENT: time is %f\n", time);
-    printf("            INSERTEVENT: future time will be %f\n", p->evtime);
+    printf("            INSERTEVENT: time is %f\n", UNITS(simtime));
+    printf("            INSERTEVENT: future time will be %f\n", UNITS(p->evtime));
   }
-  q = evlist; /* q points to front of list in which p struct inserted */
-  if (q == NULL)
-  { /* list is empty */
-    evlist = p;
-    p->next = NULL;
-    p->prev = NULL;
+  if (pdes > 0)
+  { /* stamped by the process making it, so ties come out alike for any thread count */
+    p->evseq = lps[curlp].stamps++ * nlps + curlp;
+    if (pdes > 1 && (t = lpthread(eventlp(p))) != curthread)
+    { /* it is at least lookahead away, taken in after the window */
+      post(&outboxes[curthread * pdes + t], p);
+      return;
+    }
   }
-  else
+  evinsert(p);
+}
+
+/* the same for an event of a packet sent into a channel: the medium does
+   not reorder, so it comes after every one sent into the channel before */
+void appendevent(struct event *p, struct channel *ch)
+{
+  if (evqueue != EVFIFO)
   {
-    for (qold = q; q != NULL && p->evtime > q->evtime; q = q->next)
-      qold = q;
-    if (q == NULL)
-    { /* end of list */
-      qold->next = p;
-      p->prev = qold;
-      p->next = NULL;
-    }
-    else if (q == evlist)
-    { /* front of list */
-      p->next = evlist;
-      p->prev = NULL;
-      p->next->prev = p;
-      evlist = p;
-    }
-    else
-    { /* middle of list */
-      p->next = q;
-      p->prev = q->prev;
-      q->prev->next = p;
-      q->prev = p;
-    }
+    insertevent(p);
+    return;
+  }
+  if (TRACE > 2)
+  {
+    printf("            INSERTEVENT: time is %f\n", UNITS(simtime));
+    printf("            INSERTEVENT: future time will be %f\n", UNITS(p->evtime));
   }
+  if (ch->fifo == 0)
+    ch->fifo = evnewfifo();
+  evappend(p, ch->fifo);
+}
+
+/* connections and channels are found by their hosts */
+unsigned long long connkey(int from, int to, int port)
+{
+  return ((unsigned long long)from << 42) | ((unsigned long long)to << 20) | port;
+}
+
+unsigned long long chankey(int from, int to)
+{
+  return ((unsigned long long)from << 32) | to;
 }
 
-void generate_next_arrival(void)
+struct event *newevent(void)
+{
+  struct event *evptr = slaballoc(sizeof(struct event));
+  evptr->pktptr = NULL;
+  return evptr;
+}
+
+void generate_next_arrival(struct conn *c)
 {
   double x;
   struct event *evptr;
@@ -158,30 +587,243 @@ void generate_next_arrival(void)
 
   x = lambda * jimsrand() * 2; /* x is uniform on [0,2*lambda] */
   /* having mean of lambda        */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0)
-  {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime = time + x;
+  if (burst > 0 && (c->nsim + 1) % burst != 0)
+    x *= BURSTGAP / lambda; /* within a burst */
+  evptr = newevent();
+  evptr->evtime = simtime + CLOCK(x);
   evptr->evtype = FROM_LAYER5;
   if (BIDIRECTIONAL && (jimsrand() > 0.5))
     evptr->eventity = B;
   else
     evptr->eventity = A;
+  evptr->evconn = connkey(c->host[A], c->host[B], c->port);
   insertevent(evptr);
 }
 
-void printevlist(void)
+/* look up a protocol by name */
+const struct protocol *findprotocol(const char *name)
 {
-  struct event *q;
-  printf("--------------\nEvent List Follows:\n");
-  for (q = evlist; q != NULL; q = q->next)
+  int i;
+  for (i = 0; protocols[i] != NULL; i++)
+    if (strcmp(protocols[i]->name, name) == 0)
+      return protocols[i];
+  printf("unknown protocol %s\n", name);
+  exit(EXIT_FAILURE);
+}
+
+/* make c the connection whose protocol routines are called */
+void switchto(struct conn *c)
+{
+  curconn = c;
+  Astate = c->state;
+  Bstate = c->state + ((c->proto->Asize + 7) & ~7);
+  connstats = &c->stats;
+  if (nthreads > 0)
+    rng = &conns[c->group].rng;
+}
+
+/* the channel from one host to another, made on first use */
+struct channel *findchannel(int from, int to)
+{
+  struct channel *ch = hashfind(&chantable, chankey(from, to));
+
+  if (ch == NULL)
+  {
+    ch = slaballoc(sizeof(struct channel));
+    ch->lastarrival = 0.0;
+    ch->nconns = 0;
+    ch->fifo = 0;
+    ch->route = NULL;
+    ch->lastinstant = 0.0;
+    ch->arriving = NULL;
+    hashinsert(&chantable, chankey(from, to), ch);
+  }
+  return ch;
+}
+
+/* set up the connections, one per line "from to [protocol]" of connfile
+   or, without one, connection i from host i to its neighbour i + 1 */
+void initconns(void)
+{
+  FILE *fp = NULL;
+  char line[128], name[32];
+  struct conn *c;
+  int from, to, n, i;
+
+  if (connfile != NULL)
+  {
+    fp = fopen(connfile, "r");
+    if (fp == NULL)
+    {
+      printf("cannot open connection file %s\n", connfile);
+      exit(EXIT_FAILURE);
+    }
+    nconns = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+      if (sscanf(line, "%d %d", &from, &to) == 2)
+        nconns++;
+    rewind(fp);
+  }
+  conns = slaballoc(nconns * sizeof(struct conn));
+  memset(conns, 0, nconns * sizeof(struct conn));
+  hashinit(&conntable, nconns);
+  hashinit(&chantable, 2 * (unsigned long)nconns); /* each connection uses at most two */
+
+  for (i = 0; i < nconns; i++)
+  {
+    c = &conns[i];
+    c->id = i;
+    c->proto = protocol;
+    if (fp != NULL)
+    {
+      do
+      {
+        if (fgets(line, sizeof(line), fp) == NULL)
+          line[0] = '\0';
+        n = sscanf(line, "%d %d %31s", &from, &to, name);
+      } while (n < 2);
+      if (n == 3)
+        c->proto = findprotocol(name);
+    }
+    else if (incast)
+    {
+      from = i + 1;
+      to = 0;
+    }
+    else
+    {
+      from = i % nhosts;
+      to = (i + 1) % nhosts;
+    }
+    if (from < 0 || from >= nhosts || to < 0 || to >= nhosts)
+    {
+      printf("connection %d: no such host\n", i);
+      exit(EXIT_FAILURE);
+    }
+    c->host[A] = from;
+    c->host[B] = to;
+    c->port = findchannel(from, to)->nconns++;
+    findchannel(to, from);
+    if (c->port >= MAXPORTS)
+    {
+      printf("connection %d: too many connections from host %d to host %d\n", i, from, to);
+      exit(EXIT_FAILURE);
+    }
+    hashinsert(&conntable, connkey(from, to, c->port), c);
+
+    /* share out the messages to simulate */
+    c->nsimmax = nsimmax / nconns + (i < nsimmax % nconns);
+
+    if (((c->proto->Asize + 7) & ~7) + c->proto->Bsize > CONNSTATE)
+    {
+      printf("protocol %s keeps more state than the emulator has room for.", c->proto->name);
+      exit(EXIT_FAILURE);
+    }
+    switchto(c);
+    c->proto->A_init();
+    c->proto->B_init();
+  }
+  if (fp != NULL)
+    fclose(fp);
+}
+
+/* look up a queue discipline by name */
+int finddiscipline(const char *name)
+{
+  int i;
+  for (i = 0; disciplines[i] != NULL; i++)
+    if (strcmp(disciplines[i], name) == 0)
+      return i;
+  printf("unknown queue discipline %s\n", name);
+  exit(EXIT_FAILURE);
+}
+
+/* route the packets from one host to another through the given routers */
+void addroute(int from, int to, int nhops, int hop[])
+{
+  struct channel *ch = hashfind(&chantable, chankey(from, to));
+  struct route *rt;
+  int i;
+
+  if (ch == NULL) /* no connection uses it */
+    return;
+  rt = slaballoc(sizeof(struct route) + nhops * sizeof(int));
+  rt->nhops = nhops;
+  for (i = 0; i < nhops; i++)
+    rt->hop[i] = hop[i];
+  ch->route = rt;
+}
+
+/* set up the routers, from the lines "router rate limit [discipline]" and
+   "route from to router..." of topofile, routers numbered from 0 in the
+   order given.  For incast, one router in front of host 0. */
+void inittopology(void)
+{
+  FILE *fp;
+  char line[512], name[32], *tok;
+  double rate;
+  int limit, from, to, len, n, i;
+  int hop[MAXHOPS];
+
+  nrouters = 0;
+  if (incast)
+  {
+    nrouters = 1;
+    routers = slaballoc(sizeof(struct router));
+    routerinit(&routers[0], bottleneckrate, bottlenecklimit, discipline);
+    hop[0] = 0;
+    for (i = 1; i <= incast; i++)
+      addroute(i, 0, 1, hop);
+  }
+  if (topofile == NULL)
+    return;
+  fp = fopen(topofile, "r");
+  if (fp == NULL)
+  {
+    printf("cannot open topology file %s\n", topofile);
+    exit(EXIT_FAILURE);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL)
+    if (strncmp(line, "router", 6) == 0)
+      nrouters++;
+  rewind(fp);
+  routers = slaballoc(nrouters * sizeof(struct router));
+
+  i = 0;
+  while (fgets(line, sizeof(line), fp) != NULL)
   {
-    printf("Event time: %f, type: %d entity: %d\n", q->evtime, q->evtype, q->eventity);
+    if (strncmp(line, "router", 6) == 0)
+    {
+      n = sscanf(line + 6, "%lf %d %31s", &rate, &limit, name);
+      if (n < 2 || rate <= 0 || limit < 1)
+      {
+        printf("topology: bad router line %s", line);
+        exit(EXIT_FAILURE);
+      }
+      routerinit(&routers[i++], rate, limit, n == 3 ? finddiscipline(name) : discipline);
+    }
+    else if (strncmp(line, "route", 5) == 0)
+    {
+      if (sscanf(line + 5, "%d %d %n", &from, &to, &len) < 2)
+      {
+        printf("topology: bad route line %s", line);
+        exit(EXIT_FAILURE);
+      }
+      n = 0;
+      for (tok = strtok(line + 5 + len, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n"))
+      {
+        if (n == MAXHOPS || (hop[n] = atoi(tok)) < 0 || hop[n] >= nrouters)
+        {
+          printf("topology: bad route from %d to %d\n", from, to);
+          exit(EXIT_FAILURE);
+        }
+        n++;
+      }
+      if (n > 0)
+        addroute(from, to, n, hop);
+    }
   }
-  printf("--------------\n");
+  fclose(fp);
 }
 
 void init(void) /* initialize the simulator */
@@ -191,7 +833,7 @@ void init(void) /* initialize the simulator */
 
   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
   printf("Enter the number of messages to simulate: ");
-  scanf("%d", &nsimmax);
+  scanf("%" COUNT, &nsimmax);
   printf("Enter  packet loss probability [enter 0.0 for no loss]:");
   scanf("%f", &lossprob);
   printf("Enter packet corruption probability [0.0 for no corruption]:");
@@ -218,285 +860,2509 @@ void init(void) /* initialize the simulator */
     printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
     exit(EXIT_FAILURE);
   }
-
-  /* initialise statistics */
-  window_full = 0;
-  total_ACKs_received = 0;
-  packets_resent = 0;
-  new_ACKs = 0;
-  packets_received = 0;
-  packets_lost = 0;
-  packets_corrupt = 0;
-  packets_sent = 0;
-  packets_timeout = 0;
-  messages_delivered = 0;
-
-  ntolayer3 = 0;
-  nlost = 0;
-  ncorrupt = 0;
-
-  time = 0.0;              /* initialize time to 0.0 */
-  generate_next_arrival(); /* initialize event list */
 }
 
-/********************** Student-callable ROUTINES ***********************/
-
-/* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB)
-/* A or B is trying to stop timer */
+/* union-find over connections, the root of a group being its first one */
+int findgroup(int *parent, int i)
 {
-  struct event *q;
+  while (parent[i] != i)
+    i = parent[i] = parent[parent[i]];
+  return i;
+}
 
-  if (TRACE > 1)
-    printf("          STOP TIMER: stopping timer at %f\n", time);
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q = evlist; q != NULL; q = q->next)
-    if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
-    {
-      /* remove this event */
-      if (q->next == NULL && q->prev == NULL)
-        evlist = NULL;          /* remove first and only event on list */
-      else if (q->next == NULL) /* end of list - there is one in front */
-        q->prev->next = NULL;
-      else if (q == evlist)
-      { /* front of list - there must be event after */
-        q->next->prev = NULL;
-        evlist = q->next;
-      }
-      else
-      { /* middle of list */
-        q->next->prev = q->prev;
-        q->prev->next = q->next;
-      }
-      free(q);
-      return;
-    }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+void joingroups(int *parent, int i, int j)
+{
+  i = findgroup(parent, i);
+  j = findgroup(parent, j);
+  if (i < j)
+    parent[j] = i;
+  else
+    parent[i] = j;
 }
 
-void starttimer(int AorB, double increment)
-/* A or B is trying to start timer */
+/* sort the connections into groups that share no channel or router, seed
+   a random number stream for each, and deal the groups out to the threads,
+   the largest share of connections going to the least loaded thread */
+void makeshards(void)
 {
+  int *parent = malloc(nconns * sizeof(int));
+  int *owner = malloc((nrouters + 1) * sizeof(int));
+  int *load = malloc(nconns * sizeof(int));
+  struct channel *ch;
+  struct conn *c, *first;
+  unsigned long long seed;
+  int next[MAXTHREADS];
+  int i, d, h, t, least;
 
-  struct event *q;
-  struct event *evptr;
+  if (parent == NULL || owner == NULL || load == NULL)
+  {
+    printf("memory allocation for shards failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < nconns; i++)
+    parent[i] = i;
+  for (h = 0; h < nrouters; h++)
+    owner[h] = -1;
+  for (i = 0; i < nconns; i++)
+  {
+    c = &conns[i];
+    for (d = A; d <= B; d++)
+    { /* the channels both ways, through their first connection, and their routers */
+      first = hashfind(&conntable, connkey(c->host[d], c->host[1 - d], 0));
+      if (first != NULL)
+        joingroups(parent, i, first->id);
+      ch = hashfind(&chantable, chankey(c->host[d], c->host[1 - d]));
+      for (h = 0; ch->route != NULL && h < ch->route->nhops; h++)
+        if (owner[ch->route->hop[h]] == -1)
+          owner[ch->route->hop[h]] = i;
+        else
+          joingroups(parent, i, owner[ch->route->hop[h]]);
+    }
+  }
 
-  if (TRACE > 1)
-    printf("          START TIMER: starting timer at %f\n", time);
-  /* be nice: check to see if timer is already started, if so, then  warn */
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q = evlist; q != NULL; q = q->next)
-    if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
+  for (i = 0; i < nconns; i++)
+  {
+    conns[i].group = findgroup(parent, i);
+    seed = SHARDSEED + i;
+    conns[i].rng = nextrandom(&seed);
+    load[i] = 0;
+  }
+  for (i = 0; i < nconns; i++)
+    load[conns[i].group]++;
+  for (t = 0; t <= nthreads; t++)
+    shardstart[t] = 0;
+  for (i = 0; i < nconns; i++) /* the thread of group i, kept in parent[i] */
+    if (conns[i].group == i)
     {
-      printf("Warning: attempt to start a timer that is already started\n");
-      return;
+      for (least = 0, t = 1; t < nthreads; t++)
+        if (shardstart[t] < shardstart[least])
+          least = t;
+      shardstart[least] += load[i];
+      parent[i] = least;
     }
 
-  /* create future event for when timer goes off */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0)
+  /* list the connections of each thread in order */
+  for (t = nthreads; t > 0; t--)
+    shardstart[t] = shardstart[t - 1];
+  shardstart[0] = 0;
+  for (t = 1; t <= nthreads; t++)
+    shardstart[t] += shardstart[t - 1];
+  free(shardconns);
+  shardconns = malloc(nconns * sizeof(int));
+  if (shardconns == NULL)
   {
-    printf("memory allocation for event failed.");
+    printf("memory allocation for shards failed.");
     exit(EXIT_FAILURE);
   }
-  evptr->evtime = time + increment;
-  evptr->evtype = TIMER_INTERRUPT;
-
-  evptr->eventity = AorB;
-  insertevent(evptr);
+  for (t = 0; t < nthreads; t++)
+    next[t] = shardstart[t];
+  for (i = 0; i < nconns; i++)
+    shardconns[next[parent[conns[i].group]]++] = i;
+  free(parent);
+  free(owner);
+  free(load);
 }
 
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
+/* make a logical process of every host and router and seed its random
+   number stream.  A packet spends at least one time unit in the medium,
+   and a router posts a packet on as it starts sending it, so the
+   lookahead is the least of that and the time routers take to send one. */
+void makelps(void)
 {
-  struct pkt *mypktptr;
-  struct event *evptr, *q;
-  float lastime, x;
+  unsigned long long seed;
   int i;
 
-  ntolayer3++;
-
-  /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B)))
+  nlps = nhosts + nrouters;
+  lps = slaballoc(nlps * sizeof(struct lp));
+  for (i = 0; i < nlps; i++)
   {
-    nlost++;
-    if (TRACE > 0)
-      printf("          TOLAYER3: packet being lost\n");
-    return;
+    seed = SHARDSEED + i;
+    lps[i].rng = nextrandom(&seed);
+    lps[i].stamps = 0;
   }
+  lookahead = 1.0;
+  for (i = 0; i < nrouters; i++)
+    if (1 / routers[i].rate < lookahead)
+      lookahead = 1 / routers[i].rate;
+}
 
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0)
-  {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i = 0; i < 20; i++)
-    mypktptr->payload[i] = packet.payload[i];
-  if (TRACE > 2)
-  {
-    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-           mypktptr->acknum, mypktptr->checksum);
-    for (i = 0; i < 20; i++)
-      printf("%c", mypktptr->payload[i]);
-    printf("\n");
-  }
+/* make lp the logical process whose events are made and random numbers drawn */
+void enterlp(int lp)
+{
+  curlp = lp;
+  rng = &lps[lp].rng;
+}
+
+/* the first arrivals of the connections whose sender the thread runs */
+void firstarrivals(int thread)
+{
+  struct conn *c;
+  int i;
 
-  /* create future event for arrival of packet at the other side */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0)
+  for (i = 0; i < nconns; i++)
   {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtype = FROM_LAYER3;      /* packet will pop out from layer3 */
-  evptr->eventity = (AorB + 1) % 2; /* event occurs at other entity */
-  evptr->pktptr = mypktptr;         /* save ptr to my copy of packet */
-  /* finally, compute the arrival time of packet at the other end.
-     medium can not reorder, so make sure packet arrives between 1 and 10
-     time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q = evlist; q != NULL; q = q->next)
-    if ((q->evtype == FROM_LAYER3 && q->eventity == evptr->eventity))
-      lastime = q->evtime;
-  evptr->evtime = lastime + 1 + 9 * jimsrand();
-
-  /* simulate corruption: */
-  if ((jimsrand() < corruptprob) && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B)))
-  {
-    ncorrupt++;
-    if ((x = jimsrand()) < .75)
-      mypktptr->payload[0] = 'Z'; /* corrupt payload */
-    else if (x < .875)
-      mypktptr->seqnum = 999999;
-    else
-      mypktptr->acknum = 999999;
-    if (TRACE > 0)
-      printf("          TOLAYER3: packet being corrupted\n");
+    c = &conns[i];
+    if (c->nsimmax > 0 && lpthread(c->host[A]) == thread)
+    {
+      switchto(c);
+      enterlp(c->host[A]);
+      generate_next_arrival(c);
+    }
   }
-
-  if (TRACE > 2)
-    printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
 }
 
-void tolayer5(int AorB, char datasent[20])
+/* start the statistics afresh at time t, when the warm-up is over */
+void resetstats(clocktime t)
 {
+  struct conn *c;
   int i;
-  if (TRACE > 2)
+
+  for (i = 0; i < nconns; i++)
   {
-    printf("          TOLAYER5: data received by application at ");
-    if (AorB == A)
-      printf("A: ");
-    else
-      printf("B: ");
-    for (i = 0; i < 20; i++)
-      printf("%c", datasent[i]);
-    printf("\n");
+    c = &conns[i];
+    memset(&c->stats, 0, sizeof(c->stats));
+    c->messages_delivered = 0;
+    c->ntolayer3 = 0;
+    c->nlost = 0;
+    c->ncorrupt = 0;
+    c->timeouts = 0;
+    c->maxstreak = c->streak;
+    c->ndelayed = 0;
+    c->delay = 0.0;
   }
-  messages_delivered++;
+  for (i = 0; i < nrouters; i++)
+    routerclear(&routers[i], UNITS(t));
+  memset(delayhist, 0, sizeof(delayhist));
+  nsim = 0;
+  ndelivered = obsdelivered = 0;
+  warmedup = t;
 }
 
-int main(void)
+/* get ready to observe the goodput from the current time on */
+void startobserving(void)
 {
-  struct event *eventptr;
-  struct msg msg2give;
-  struct pkt pkt2give;
-
-  int i, j;
+  warming = warmup != 0;
+  warmend = -1.0;
+  stoppedearly = 0;
+  ndelivered = obsdelivered = 0;
+  batchn = 0;
+  batchsum = 0.0;
+  nseries = 0;
+  steadyn = steadysum = steadysq = 0.0;
+  if (warmup == WARMTIME)
+    nextobs = CLOCK(warmat) > simtime ? CLOCK(warmat) : simtime;
+  else if (warmup != 0 || tolerance > 0)
+    nextobs = simtime + CLOCK(OBSERVE);
+  else
+    nextobs = NEVER;
+}
 
-  init();
-  A_init();
-  B_init();
+/* MSER-5: the number of batches to truncate, the one that leaves the
+   smallest squared standard error of the mean of the rest, looked for in
+   the first half of the series */
+int mser(double *b, int n)
+{
+  double sum = 0.0, sumsq = 0.0, m, best = INFINITY;
+  int d, dbest = 0;
 
-  while (1)
+  for (d = n - 1; d >= 0; d--)
   {
-    eventptr = evlist; /* get next event to simulate */
-    if (eventptr == NULL)
-      goto terminate;
-    evlist = evlist->next; /* remove this event from event list */
-    if (evlist != NULL)
-      evlist->prev = NULL;
-    if (TRACE >= 2)
-    {
-      printf("\nEVENT time: %f,", eventptr->evtime);
-      printf("  type: %d", eventptr->evtype);
-      if (eventptr->evtype == 0)
-        printf(", timerinterrupt  ");
-      else if (eventptr->evtype == 1)
-        printf(", fromlayer5 ");
-      else
-        printf(", fromlayer3 ");
-      printf(" entity: %d\n", eventptr->eventity);
+    sum += b[d];
+    sumsq += b[d] * b[d];
+    m = n - d;
+    if (d <= n / 2 && (sumsq - sum * sum / m) / (m * m) <= best)
+    {
+      best = (sumsq - sum * sum / m) / (m * m);
+      dbest = d;
+    }
+  }
+  return dbest;
+}
+
+/* take in the mean goodput of a batch of observations ending at time t,
+   and tell whether the run should go on */
+int addbatch(double mean, clocktime t)
+{
+  double halfwidth;
+  int d;
+
+  if (warming)
+  {
+    if (nseries == MSERMAX)
+      return 1; /* no end in sight, the statistics keep the warm-up */
+    series[nseries++] = mean;
+    if (nseries >= MSERMIN && (d = mser(series, nseries)) < nseries / 2)
+    { /* steady from batch d on, and certainly from now on */
+      warmend = UNITS(t) - (nseries - d) * MSERBATCH * OBSERVE;
+      warming = 0;
+      resetstats(t);
+    }
+    return 1;
+  }
+  steadyn++;
+  steadysum += mean;
+  steadysq += mean * mean;
+  if (tolerance <= 0 || steadyn < STEADYMIN)
+    return 1;
+  halfwidth = 1.96 * sqrt((steadysq - steadysum * steadysum / steadyn) / (steadyn - 1) / steadyn);
+  if (halfwidth > tolerance * steadysum / steadyn)
+    return 1;
+  stoppedearly = 1;
+  return 0;
+}
+
+/* take the observations of the goodput due by time t, and tell whether
+   the run should go on */
+int observe(clocktime t)
+{
+  while (nextobs <= t)
+  {
+    if (warming && warmup == WARMTIME)
+    {
+      warming = 0;
+      resetstats(nextobs);
+    }
+    else
+    {
+      batchsum += (ndelivered - obsdelivered) / OBSERVE;
+      obsdelivered = ndelivered;
+      if (++batchn == MSERBATCH)
+      {
+        if (!addbatch(batchsum / MSERBATCH, nextobs))
+          return 0;
+        batchn = 0;
+        batchsum = 0.0;
+      }
+    }
+    nextobs += CLOCK(OBSERVE);
+  }
+  return 1;
+}
+
+void setup(void) /* set up the network for a run */
+{
+  int i;
+
+  slabreset();
+  evreset();
+  simtime = 0.0; /* initialize time to 0.0 */
+  nsim = 0;
+  nevents = 0;
+  shardbytes = 0;
+  warmedup = 0;
+  logweight = 0.0;
+  startobserving();
+  memset(delayhist, 0, sizeof(delayhist));
+  initconns();
+  inittopology();
+  if (snapfile != NULL)
+  { /* draw from a stream a snapshot can save */
+    seqrng = SHARDSEED;
+    rng = &seqrng;
+  }
+  if (nthreads > 0)
+  { /* the threads generate the first arrivals */
+    makeshards();
+    return;
+  }
+  if (pdes > 0)
+  { /* and so do those of the parallel engine */
+    makelps();
+    if (pdes == 1)
+      firstarrivals(0);
+    return;
+  }
+  for (i = 0; i < nconns; i++) /* initialize event list */
+    if (conns[i].nsimmax > 0)
+      generate_next_arrival(&conns[i]);
+}
+
+/* a pointer into the slab pool of a snapshot, moved by delta bytes */
+void *moved(void *p, ptrdiff_t delta)
+{
+  return p == NULL ? NULL : (char *)p + delta;
+}
+
+/* save the whole state of the run to snapfile, and go on with it.  The
+   pending events are taken out of the queue to be listed and put back
+   last first, so they come out as they would have. */
+void writesnapshot(void)
+{
+  struct snaphead h;
+  struct event **ev = NULL, *p;
+  unsigned long max = 0, i;
+  long page = sysconf(_SC_PAGESIZE);
+  FILE *fp;
+
+  memset(&h, 0, sizeof(h));
+  while ((p = evpop()) != NULL)
+  {
+    if (h.npending == max)
+    {
+      max = max ? 2 * max : 1024;
+      ev = realloc(ev, max * sizeof(struct event *));
+      if (ev == NULL)
+      {
+        printf("memory allocation for the snapshot failed.");
+        exit(EXIT_FAILURE);
+      }
+    }
+    ev[h.npending++] = p;
+  }
+  memcpy(h.magic, SNAPMAGIC, sizeof(h.magic));
+  h.connsize = sizeof(struct conn);
+  h.eventsize = sizeof(struct event);
+  h.clock = SIMCLOCK;
+  h.countsize = sizeof(counter);
+  h.nhosts = nhosts;
+  h.nconns = nconns;
+  h.nrouters = nrouters;
+  h.adaptive_rto = adaptive_rto;
+  h.congestion_control = congestion_control;
+  h.ecn = ecn;
+  h.evqueue = evqueue;
+  h.simtime = simtime;
+  h.nsim = nsim;
+  h.nsimmax = nsimmax;
+  h.nevents = nevents;
+  h.rng = seqrng;
+  h.conns = conns;
+  h.conntable = conntable;
+  h.chantable = chantable;
+  h.routers = routers;
+  for (i = 0; protocols[i] != NULL; i++)
+    h.protocols[i] = protocols[i];
+  h.image = (sizeof(h) + h.npending * sizeof(struct event *) + page - 1) / page * page;
+  slabsave(&h.slab);
+
+  fp = fopen(snapfile, "wb");
+  if (fp == NULL)
+  {
+    printf("cannot open snapshot file %s\n", snapfile);
+    exit(EXIT_FAILURE);
+  }
+  fwrite(&h, sizeof(h), 1, fp);
+  fwrite(ev, sizeof(struct event *), h.npending, fp);
+  fseek(fp, h.image, SEEK_SET);
+  fwrite(slabbase(), 1, h.slab.top, fp);
+  if (ferror(fp) | fclose(fp))
+  {
+    printf("writing snapshot file %s failed\n", snapfile);
+    exit(EXIT_FAILURE);
+  }
+  for (i = h.npending; i-- > 0;)
+    evinsert(ev[i]);
+  free(ev);
+  printf("snapshot at time %f written to %s\n", UNITS(simtime), snapfile);
+}
+
+/* resume the run saved in loadfile instead of setting one up: map the
+   pool's image, move every pointer into it by as much as the pool moved,
+   and queue the pending events again.  The messages to simulate are
+   shared out anew, and connections that had sent all of theirs go on if
+   they now have more. */
+void loadsnapshot(void)
+{
+  struct snaphead h;
+  struct event **ev;
+  struct channel *ch;
+  struct conn *c;
+  struct event *p;
+  struct netpkt *q;
+  char *pending;
+  ptrdiff_t delta;
+  unsigned long i;
+  int j;
+  FILE *fp;
+
+  fp = fopen(loadfile, "rb");
+  if (fp == NULL || fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, SNAPMAGIC, sizeof(h.magic)) != 0)
+  {
+    printf("cannot read snapshot file %s\n", loadfile);
+    exit(EXIT_FAILURE);
+  }
+  if (h.connsize != sizeof(struct conn) || h.eventsize != sizeof(struct event) || h.clock != SIMCLOCK ||
+      h.countsize != sizeof(counter))
+  {
+    printf("snapshot file %s was written by another build of the emulator\n", loadfile);
+    exit(EXIT_FAILURE);
+  }
+  ev = malloc(h.npending * sizeof(struct event *) + 1);
+  if (ev == NULL || fread(ev, sizeof(struct event *), h.npending, fp) != h.npending)
+  {
+    printf("cannot read snapshot file %s\n", loadfile);
+    exit(EXIT_FAILURE);
+  }
+  evreset();
+  delta = slabload(&h.slab, fileno(fp), h.image);
+  fclose(fp);
+
+  nhosts = h.nhosts;
+  nconns = h.nconns;
+  nrouters = h.nrouters;
+  adaptive_rto = h.adaptive_rto;
+  congestion_control = h.congestion_control;
+  ecn = h.ecn;
+  evqueue = h.evqueue;
+  simtime = h.simtime;
+  nsim = h.nsim;
+  nevents = h.nevents;
+  seqrng = h.rng;
+  rng = &seqrng;
+  shardbytes = 0;
+
+  conns = moved(h.conns, delta);
+  conntable = h.conntable;
+  chantable = h.chantable;
+  hashmove(&conntable, delta);
+  hashmove(&chantable, delta);
+  for (i = 0; i <= chantable.mask; i++)
+    if ((ch = chantable.slots[i].val) != NULL)
+    {
+      ch->route = moved(ch->route, delta);
+      ch->arriving = moved(ch->arriving, delta);
+      ch->fifo = 0; /* the queue's FIFOs are made again as they are used */
+    }
+  routers = moved(h.routers, delta);
+  for (j = 0; j < nrouters; j++)
+  {
+    routermove(&routers[j], delta);
+    for (p = routers[j].head; p != NULL; p = p->next)
+      p->pktptr = moved(p->pktptr, delta);
+  }
+  for (j = 0; j < nconns; j++)
+  {
+    c = &conns[j];
+    c->timer[A] = moved(c->timer[A], delta);
+    c->timer[B] = moved(c->timer[B], delta);
+    for (i = 0; h.protocols[i] != c->proto; i++)
+      ;
+    c->proto = protocols[i];
+  }
+
+  pending = calloc(nconns, 1);
+  if (pending == NULL)
+  {
+    printf("memory allocation for the snapshot failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i = h.npending; i-- > 0;)
+  {
+    p = moved(ev[i], delta);
+    p->pktptr = moved(p->pktptr, delta);
+    for (q = (struct netpkt *)p->pktptr; q != NULL; q = (struct netpkt *)q->next)
+      q->next = moved(q->next, delta); /* and those arriving with it */
+    evinsert(p);
+    if (p->evtype == FROM_LAYER5)
+      pending[((struct conn *)hashfind(&conntable, p->evconn))->id] = 1;
+  }
+  for (j = 0; j < nconns; j++)
+  {
+    c = &conns[j];
+    c->nsimmax = nsimmax / nconns + (j < nsimmax % nconns);
+    if (!pending[j] && c->nsim < c->nsimmax)
+    {
+      switchto(c);
+      generate_next_arrival(c);
+    }
+  }
+  free(pending);
+  free(ev);
+  startobserving();
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+double gettime(void)
+{
+  return UNITS(simtime);
+}
+
+/* called by students routine to cancel a previously-started timer */
+void stoptimer(int AorB)
+/* A or B is trying to stop timer */
+{
+  struct event *q;
+
+  if (TRACE > 1)
+    printf("          STOP TIMER: stopping timer at %f\n", UNITS(simtime));
+  q = curconn->timer[AorB];
+  if (q != NULL)
+  {
+    evremove(q); /* remove this event */
+    slabfree(q, sizeof(struct event));
+    curconn->timer[AorB] = NULL;
+    return;
+  }
+  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+}
+
+void starttimer(int AorB, double increment)
+/* A or B is trying to start timer */
+{
+
+  struct event *evptr;
+
+  if (TRACE > 1)
+    printf("          START TIMER: starting timer at %f\n", UNITS(simtime));
+  /* be nice: check to see if timer is already started, if so, then  warn */
+  if (curconn->timer[AorB] != NULL)
+  {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+
+  /* create future event for when timer goes off */
+  evptr = newevent();
+  evptr->evtime = simtime + CLOCK(increment);
+  evptr->evtype = TIMER_INTERRUPT;
+
+  evptr->eventity = AorB;
+  evptr->evconn = connkey(curconn->host[A], curconn->host[B], curconn->port);
+  curconn->timer[AorB] = evptr;
+  insertevent(evptr);
+}
+
+/************************** TOLAYER3 ***************/
+/* an arrival time rounded up to the next multiple of the quantum */
+clocktime quantize(clocktime t)
+{
+#if SIMCLOCK == TICKCLOCK
+  clocktime q = CLOCK(quantum);
+
+  return (t + q - 1) / q * q;
+#else
+  return ceil(t / quantum) * quantum;
+#endif
+}
+
+/* round the arrival of a packet sent into a channel without routers, so
+   that packets fall on the same instant.  One due when the latest packet
+   sent into the channel arrives, or before, joins it if it goes to the
+   same entity: the event then brings both, in the order they were sent,
+   and is freed.  Else it comes at the next instant, behind it, for the
+   medium does not reorder.  Returns whether the packet joined. */
+int coincide(struct channel *ch, struct event *p)
+{
+  struct netpkt *q;
+
+  p->evtime = quantize(p->evtime);
+  if (p->evtime <= ch->lastinstant)
+  { /* still pending, as it is later than now */
+    if (ch->arriving->evconn == p->evconn && ch->arriving->eventity == p->eventity)
+    {
+      for (q = (struct netpkt *)ch->arriving->pktptr; q->next != NULL; q = (struct netpkt *)q->next)
+        ;
+      q->next = p->pktptr;
+      slabfree(p, sizeof(struct event));
+      return 1;
+    }
+    p->evtime = ch->lastinstant + CLOCK(quantum);
+  }
+  ch->lastinstant = p->evtime;
+  ch->arriving = p;
+  return 0;
+}
+
+void tolayer3_burst(int AorB, struct pkt packets[], int n)
+/* A or B is sending n packets to network, as n calls of tolayer3 would */
+{
+  struct pkt *mypktptr;
+  struct event *evptr;
+  struct conn *c = curconn;
+  struct channel *ch;
+  unsigned long long key;
+  clocktime lastime;
+  float x;
+  double u;
+  counter *sent = &c->ntolayer3, *lost = &c->nlost, *corrupt = &c->ncorrupt;
+  int affected, i, k;
+
+  if (pdes > 0 && AorB == B)
+  {
+    sent = &c->Bntolayer3;
+    lost = &c->Bnlost;
+    corrupt = &c->Bncorrupt;
+  }
+  *sent += n;
+
+  /* what is the same for every packet of the burst: the channel they
+     share, the connection and whether loss and corruption apply */
+  ch = hashfind(&chantable, chankey(c->host[AorB], c->host[(AorB + 1) % 2]));
+  key = connkey(c->host[A], c->host[B], c->port);
+  affected = !(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B);
+
+  for (k = 0; k < n; k++)
+  {
+    /* simulate losses: */
+    u = jimsrand();
+    if (lossbias > 0 && affected)
+    { /* importance sampling: drawn at the biased probability, and the run
+         weighed by how much likelier that made it */
+      logweight += u < lossbias ? lostweight : keptweight;
+      u = u < lossbias ? 0.0 : 1.0;
+    }
+    if (u < lossprob && affected)
+    {
+      (*lost)++;
+      if (TRACE > 0)
+        printf("          TOLAYER3: packet being lost\n");
+      continue;
+    }
+
+    /* make a copy of the packet student just gave me since he/she may decide */
+    /* to do something with the packet after we return back to him/her */
+    mypktptr = slaballoc(sizeof(struct netpkt));
+    mypktptr->seqnum = packets[k].seqnum;
+    mypktptr->acknum = packets[k].acknum;
+    mypktptr->checksum = packets[k].checksum;
+    mypktptr->flags = packets[k].flags;
+    ((struct netpkt *)mypktptr)->sent = simtime;
+    ((struct netpkt *)mypktptr)->next = NULL;
+    for (i = 0; i < 20; i++)
+      mypktptr->payload[i] = packets[k].payload[i];
+    if (TRACE > 2)
+    {
+      printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
+             mypktptr->acknum, mypktptr->checksum);
+      for (i = 0; i < 20; i++)
+        printf("%c", mypktptr->payload[i]);
+      printf("\n");
+    }
+
+    /* create future event for arrival of packet at the other side */
+    evptr = newevent();
+    evptr->evtype = FROM_LAYER3;      /* packet will pop out from layer3 */
+    evptr->eventity = (AorB + 1) % 2; /* event occurs at other entity */
+    evptr->evconn = key;
+    evptr->pktptr = mypktptr; /* save ptr to my copy of packet */
+    /* finally, compute the arrival time of packet at the other end.
+       medium can not reorder, so make sure packet arrives between 1 and 10
+       time units after the latest arrival time of packets
+       currently in the medium on their way to the destination */
+    lastime = simtime;
+    if (ch->lastarrival > lastime)
+      lastime = ch->lastarrival;
+    evptr->evtime = lastime + CLOCK(1) + CLOCK(9 * jimsrand());
+    ch->lastarrival = evptr->evtime;
+    if (ch->route != NULL)
+    { /* it has routers to pass first */
+      evptr->evtype = TO_ROUTER;
+      evptr->evhop = 0;
+    }
+
+    /* simulate corruption: */
+    if ((jimsrand() < corruptprob) && affected)
+    {
+      (*corrupt)++;
+      if ((x = jimsrand()) < .75)
+        mypktptr->payload[0] = 'Z'; /* corrupt payload */
+      else if (x < .875)
+        mypktptr->seqnum = 999999;
+      else
+        mypktptr->acknum = 999999;
+      if (TRACE > 0)
+        printf("          TOLAYER3: packet being corrupted\n");
+    }
+
+    if (TRACE > 2)
+      printf("          TOLAYER3: scheduling arrival on other side\n");
+    if (quantum > 0 && ch->route == NULL && coincide(ch, evptr))
+      continue;
+    appendevent(evptr, ch);
+  }
+}
+
+void tolayer3(int AorB, struct pkt packet)
+/* A or B is sending to network  */
+{
+  tolayer3_burst(AorB, &packet, 1);
+}
+
+/* the bin of the delay histogram for a delay of d time units: HISTOCTAVE
+   bins of equal width to an octave, the first from 1/16 time unit */
+int delaybin(double d)
+{
+  int e, b;
+  double m = frexp(d, &e); /* d = m * 2^e with m in [0.5, 1) */
+
+  if (d <= 0)
+    return 0;
+  b = (e + 3) * HISTOCTAVE + (int)((2 * m - 1) * HISTOCTAVE);
+  return b < 0 ? 0 : b >= HISTBINS ? HISTBINS - 1 : b;
+}
+
+/* tail runs: A of the connection took a message */
+void msgtaken(struct conn *c)
+{
+  struct latency *l = &latencies[c - conns];
+
+  if (l->n < LATSLOTS)
+    l->born[(l->first + l->n++) % LATSLOTS] = simtime;
+}
+
+/* and B delivered the oldest of them */
+void msgdelivered(struct conn *c)
+{
+  struct latency *l = &latencies[c - conns];
+  double d;
+
+  if (l->n == 0)
+    return;
+  d = UNITS(simtime - l->born[l->first]);
+  l->first = (l->first + 1) % LATSLOTS;
+  l->n--;
+  msghist[delaybin(d)]++;
+  msgsum += d;
+}
+
+/* scenario runs: the messages from A have got to the next phase, with
+   the loss probability of its own */
+void nextphase(void)
+{
+  phase++;
+  lossprob = losses[phase];
+  phasestart[phase] = simtime;
+  phaseswitches[phase] = modeswitches;
+  if (TRACE > 0)
+    printf("          PHASE %d: loss probability %g\n", phase, lossprob);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  int i;
+  if (TRACE > 2)
+  {
+    printf("          TOLAYER5: data received by application at ");
+    if (AorB == A)
+      printf("A: ");
+    else
+      printf("B: ");
+    for (i = 0; i < 20; i++)
+      printf("%c", datasent[i]);
+    printf("\n");
+  }
+  curconn->messages_delivered++;
+  curconn->lastdelivery = simtime;
+  ndelivered++;
+  if (burst > 0)
+    msgdelivered(curconn);
+  if (nphases > 0)
+    phasedelivered[phase]++;
+}
+
+/************************** ROUTERS ***************/
+
+/* the route of an event's packet, and the router it is at or on its way to */
+struct route *eventroute(struct conn *c, struct event *p)
+{
+  struct channel *ch = hashfind(&chantable, chankey(c->host[(p->eventity + 1) % 2], c->host[p->eventity]));
+  return ch->route;
+}
+
+struct router *hoprouter(struct conn *c, struct event *p)
+{
+  return &routers[eventroute(c, p)->hop[p->evhop]];
+}
+
+/* the logical process an event happens in */
+int eventlp(struct event *p)
+{
+  struct conn *c = hashfind(&conntable, p->evconn);
+
+  if (p->evtype == TO_ROUTER || p->evtype == FROM_ROUTER)
+    return nhosts + eventroute(c, p)->hop[p->evhop];
+  return c->host[p->eventity];
+}
+
+/* the packet at the head of the queue starts on the link, if it is idle */
+void forward(struct router *r)
+{
+  struct event *p, *q;
+
+  if (r->busy || (p = routerdequeue(r)) == NULL)
+    return;
+  p->evtime = simtime + CLOCK(1 / r->rate);
+  p->evtype = FROM_ROUTER;
+  if (pdes > 0)
+  { /* the packet is posted on to where it goes next now, for when it has
+       been sent, and an event of the router's own frees the link then */
+    q = newevent();
+    *q = *p;
+    q->pktptr = NULL;
+    insertevent(q);
+    p->evhop++;
+    if (p->evhop < eventroute(hashfind(&conntable, p->evconn), p)->nhops)
+      p->evtype = TO_ROUTER;
+    else
+      p->evtype = FROM_LAYER3;
+  }
+  insertevent(p);
+}
+
+/* the packet has reached router r */
+void torouter(struct router *r, struct event *p)
+{
+  p->evtime = simtime; /* kept while it waits */
+  routerenqueue(r, p);
+  forward(r);
+}
+
+void routerdrop(struct event *p)
+{
+  if (TRACE > 0)
+    printf("          ROUTER: packet being dropped\n");
+  slabfree(p->pktptr, sizeof(struct netpkt));
+  slabfree(p, sizeof(struct event));
+}
+
+void routerreport(void)
+{
+  struct router *r;
+  int i;
+
+  printf("\nrouter  discipline    rate  limit  arrivals     drops     marks  most queued  mean queued\n");
+  for (i = 0; i < nrouters; i++)
+  {
+    r = &routers[i];
+    printf("%6d  %-10s %7.3f %6d %9lu %9lu %9lu %12d %12.3f\n", i, disciplines[r->discipline], r->rate, r->limit,
+           r->arrivals, r->drops, r->marks, r->maxlength, routermean(r));
+  }
+}
+
+/* where the statistics started, and why the run stopped */
+void steadyreport(void)
+{
+  if (warmup == WARMTIME)
+    printf("statistics from time %f on, after the warm-up\n", UNITS(warmedup));
+  else if (warmup == WARMMSER && warmend >= 0)
+    printf("warm-up over by time %f (MSER-5), statistics from time %f on\n", warmend, UNITS(warmedup));
+  else if (warmup == WARMMSER)
+    printf("no end of the warm-up found (MSER-5), statistics from time 0 on\n");
+  if (stoppedearly)
+    printf("stopped early: goodput %f messages per time unit, to within %g of it\n", steadysum / steadyn,
+           tolerance);
+}
+
+void usage(void)
+{
+  printf("usage: emulator [-n hosts] [-c connections] [-f connection-file] [-p abp|gbn|sr|tcp|hybrid]\n"
+         "                [-q list|heap|fifo|all] [-B] [-S] [-r] [-F] [-G | -g] [-C] [-E | -e] [-t topology-file] [-D droptail|red|codel]\n"
+         "                [-I senders [-R rate] [-Q limit]] [-j threads | -P threads]\n"
+         "                [-W snapshot-file -T time] [-L snapshot-file] [-w time|mser] [-s tolerance]\n"
+         "                [-m width [-k processes] [-M cache-directory]] [-b biased-loss]\n"
+         "                [-O delay-bound [-k processes] [-M cache-directory]] [-M cache-directory -X]\n"
+         "                [-l burst] [-v loss,loss,...] [-A quantum [-U]]\n"
+         "-M caches the replicates of -m and the candidates of -O, not other runs;\n"
+         "-X empties the cache first, and without -m or -O does nothing else\n");
+  exit(EXIT_FAILURE);
+}
+
+/* the chance that a packet A (AorB == A) or B sends is lost or corrupted */
+double failprob(int AorB)
+{
+  if ((AorB == A && corruptdirection == B) || (AorB == B && corruptdirection == A))
+    return 0.0;
+  return 1 - (1 - lossprob) * (1 - corruptprob);
+}
+
+/* closed-form goodput, in messages per time unit, of a connection alone on
+   its channel that resends as given, with the given window and timeout;
+   and its efficiency, the part of the packets A sends that deliver a
+   message.  A round trip takes 2 * HOPDELAY, and a packet fails with
+   probability p, when it or its ACK is lost; go-back-N only needs one of
+   the ACKs outstanding through.  A loss stalls the window for a timeout,
+   as the window cannot move past the packet lost and one timer serves
+   it, and go-back-N resends every packet outstanding with it.  Messages
+   that find the window full are dropped, as in an Erlang loss system of
+   window slots.  The goodput is at most the rate the channel carries
+   useful packets.  A protocol switching between go-back-N and selective
+   repeat gets at most the better of the two. */
+double throughputmodel(int resend, int window, double timeout, double *efficiency)
+{
+  double pd = failprob(A), pa = failprob(B), p, hold, load, blocked, rate, busy, g, e;
+  int k;
+
+  if (window == 1)
+    resend = STOPWAIT;
+  if (resend == SWITCHING)
+  {
+    rate = throughputmodel(SELECTIVE, window, timeout, efficiency);
+    if ((g = throughputmodel(GOBACKN, window, timeout, &e)) <= rate)
+      return rate;
+    *efficiency = e;
+    return g;
+  }
+  p = 1 - (1 - pd) * (1 - (resend == GOBACKN ? pow(pa, window) : pa));
+  if (p >= 1)
+  {
+    *efficiency = 0.0;
+    return 0.0;
+  }
+  hold = window * (2 * HOPDELAY / window + p / (1 - p) * timeout); /* a slot, per message */
+  load = hold / lambda;
+  for (blocked = 1.0, k = 1; k <= window; k++)
+    blocked = load * blocked / (k + load * blocked);
+  rate = (1 - blocked) / lambda;
+  busy = resend == GOBACKN && load * (1 - blocked) > 1 ? load * (1 - blocked) : 1.0; /* packets outstanding */
+  p = 1 - (1 - pd) * (1 - pow(pa, busy));
+  *efficiency = (1 - p) / (1 + (busy - 1) * p);
+  if (rate > *efficiency / HOPDELAY)
+    rate = *efficiency / HOPDELAY;
+  return rate;
+}
+
+/* the model next to the run, for a single connection without routers.  A
+   protocol that switches is held to the go-back-N and the selective
+   repeat line both, and is off the model only when it is off both. */
+void modelreport(double goodput, double efficiency)
+{
+  static const char *names[] = {"stop-and-wait", "go-back-N", "selective repeat"};
+  const struct protocol *proto = conns[0].proto; /* a connection file may give it another than -p */
+  int window = window_limit > 0 && window_limit < proto->window ? window_limit : proto->window;
+  double timeout = rto_initial > 0 ? rto_initial : proto->rtt, g, e, eg[SELECTIVE + 1], ee[SELECTIVE + 1];
+  int k, own = window == 1 ? STOPWAIT : proto->resend, off;
+
+  printf("\nthroughput model: window %d, timeout %g, mean channel delay %g, packets failing %g A->B, %g B->A%s\n",
+         window, timeout, HOPDELAY, failprob(A), failprob(B),
+         congestion_control || adaptive_rto || proto->adapts ? " (the model keeps both fixed)" : "");
+  printf("                    goodput  efficiency\n");
+  for (k = STOPWAIT; k <= SELECTIVE; k++)
+  {
+    g = throughputmodel(k, k == STOPWAIT ? 1 : window, timeout, &e);
+    printf("%-16s %10.6f %11.4f\n", names[k], g, e);
+    eg[k] = g > 0 ? goodput / g - 1 : 0.0;
+    ee[k] = e > 0 ? efficiency / e - 1 : 0.0;
+  }
+  printf("simulated (%s) %*s%10.6f %11.4f   relative error ", proto->name, (int)(4 - strlen(proto->name)), "",
+         goodput, efficiency);
+  if (own == SWITCHING)
+  {
+    printf("%+.1f%%, %+.1f%% to go-back-N, %+.1f%%, %+.1f%% to selective repeat\n", 100 * eg[GOBACKN],
+           100 * ee[GOBACKN], 100 * eg[SELECTIVE], 100 * ee[SELECTIVE]);
+    off = (fabs(eg[GOBACKN]) > MODELTOL || fabs(ee[GOBACKN]) > MODELTOL) &&
+          (fabs(eg[SELECTIVE]) > MODELTOL || fabs(ee[SELECTIVE]) > MODELTOL);
+  }
+  else
+  {
+    printf("%+.1f%%, %+.1f%%\n", 100 * eg[own], 100 * ee[own]);
+    off = fabs(eg[own]) > MODELTOL || fabs(ee[own]) > MODELTOL;
+  }
+  if ((window + 1) * HOPDELAY > timeout && window > 1)
+    printf("a full window takes longer than the timeout to be ACKed: spurious timeouts, which the model leaves out\n");
+  if (off)
+    printf("the run is more than %g%% off the model: a protocol bug, or too short a run\n", 100 * MODELTOL);
+}
+
+void report(void)
+{
+  struct stats total = {0};
+  struct conn *c;
+  counter messages_delivered = 0, ndelayed = 0;
+  double delay = 0.0;
+  int i;
+
+  for (i = 0; i < nconns; i++)
+  {
+    c = &conns[i];
+    total.window_full += c->stats.window_full;
+    total.total_ACKs_received += c->stats.total_ACKs_received;
+    total.packets_resent += c->stats.packets_resent;
+    total.new_ACKs += c->stats.new_ACKs;
+    total.packets_received += c->stats.packets_received;
+    messages_delivered += c->messages_delivered;
+    ndelayed += c->ndelayed;
+    delay += c->delay;
+  }
+
+  printf(" Simulator terminated at time %f\n after attempting to send %" COUNT " msgs from layer5\n", UNITS(simtime), nsim);
+  steadyreport();
+  if (lossbias > 0)
+    printf("losses drawn at %g instead of %g, likelihood ratio of the run %g\n", lossbias, lossprob, exp(logweight));
+  printf("number of messages dropped due to full window:  %" COUNT " \n", total.window_full);
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %" COUNT " \n", total.new_ACKs);
+  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
+  printf("number of packet resends by A:  %" COUNT " \n", total.packets_resent);
+  printf("number of correct packets received at B:  %" COUNT " \n", total.packets_received);
+  printf("number of messages delivered to application:  %" COUNT " \n", messages_delivered);
+
+  if (nrouters > 0)
+  {
+    printf("mean time of packets from A to B in the network: %f\n", ndelayed > 0 ? delay / ndelayed : 0.0);
+    routerreport();
+  }
+  if (nconns == 1)
+  {
+    if (nrouters == 0 && burst == 0 && nphases == 0 && simtime > warmedup) /* the model has neither bursts nor phases */
+      modelreport(messages_delivered / UNITS(simtime - warmedup),
+                  messages_delivered / (double)(nsim - total.window_full + total.packets_resent));
+    return;
+  }
+  printf("memory in use: %lu bytes, %.1f per connection\n", (unsigned long)(slabsize() + evsize() + shardbytes),
+         (double)(slabsize() + evsize() + shardbytes) / nconns);
+  if (nconns > MAXLISTED)
+    return;
+  printf("\nconn  hosts    proto   msgs  full  newACKs  resends  received  delivered  tolayer3  lost  corrupt\n");
+  for (i = 0; i < nconns; i++)
+  {
+    c = &conns[i];
+    printf("%4d  %3d->%-3d %-5s %6" COUNT " %5" COUNT " %8" COUNT " %8" COUNT " %9" COUNT " %10" COUNT " %9" COUNT
+           " %5" COUNT " %8" COUNT "\n", c->id, c->host[A], c->host[B],
+           c->proto->name, c->nsim, c->stats.window_full, c->stats.new_ACKs, c->stats.packets_resent,
+           c->stats.packets_received, c->messages_delivered, c->ntolayer3, c->nlost, c->ncorrupt);
+  }
+}
+
+/* the upper end of a bin */
+double binlimit(int b)
+{
+  return ldexp(1 + (b % HISTOCTAVE + 1.0) / HISTOCTAVE, b / HISTOCTAVE - 4);
+}
+
+/* the packet of a FROM_LAYER3 event as it is given to the entity, after
+   which the emulator's copy is freed */
+struct pkt arrival(struct conn *c, struct event *p)
+{
+  struct pkt pkt2give;
+  double d;
+  int i;
+
+  pkt2give.seqnum = p->pktptr->seqnum;
+  pkt2give.acknum = p->pktptr->acknum;
+  pkt2give.checksum = p->pktptr->checksum;
+  pkt2give.flags = p->pktptr->flags;
+  for (i = 0; i < 20; i++)
+    pkt2give.payload[i] = p->pktptr->payload[i];
+  if (p->eventity == B)
+  {
+    d = UNITS(simtime - ((struct netpkt *)p->pktptr)->sent);
+    c->ndelayed++;
+    c->delay += d;
+    delayhist[delaybin(d)]++;
+  }
+  slabfree(p->pktptr, sizeof(struct netpkt)); /* free the memory for packet */
+  return pkt2give;
+}
+
+double wallclock(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* the memory the process holds now, in kB, 0 where /proc can't tell.
+   Not the peak getrusage() gives, which never goes down. */
+long residentkb(void)
+{
+  FILE *fp = fopen("/proc/self/statm", "r");
+  long size, pages = 0;
+
+  if (fp == NULL)
+    return 0;
+  if (fscanf(fp, "%ld %ld", &size, &pages) != 2)
+    pages = 0;
+  fclose(fp);
+  return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* a sample of a soak run: the memory held after so many events */
+void soaksample(void)
+{
+  size_t bytes = slabsize() + evsize();
+  long rss = residentkb();
+
+  if (soaksamples++ == 0)
+  {
+    soakbytes = bytes;
+    soakrss = rss;
+  }
+  printf("%13llu %12.0f %14" COUNT " %12lu %12ld %9.1f\n", nevents, UNITS(simtime), nsim, (unsigned long)bytes, rss,
+         wallclock() - soakstart);
+  fflush(stdout);
+}
+
+/* take the next event off the queue, doing what is done for every event:
+   the snapshot and the observations due before it, the soak samples, the
+   fingerprint of the order of events and the trace.  NULL once there are
+   no events left in the window, or the goodput is known closely enough. */
+struct event *nextevent(void)
+{
+  struct event *eventptr;
+  struct conn *c;
+  unsigned long long bits;
+  double t;
+
+  while (1)
+  {
+    eventptr = evpeek(); /* get next event to simulate, if it is in the window */
+    if (eventptr == NULL || eventptr->evtime >= horizon)
+      return NULL;
+    if (eventptr->evtime < snaptime)
+      break;
+    snaptime = NEVER;
+    writesnapshot();
+  }
+  if (eventptr->evtime >= nextobs && !observe(eventptr->evtime))
+    return NULL; /* the goodput is known closely enough */
+  evpop();
+  nevents++;
+  if (soak && (nevents & (SOAKEVERY - 1)) == 0)
+    soaksample();
+  if (checkorder)
+  {
+    t = UNITS(eventptr->evtime);
+    memcpy(&bits, &t, sizeof(bits));
+    fold(&evorder, eventptr->evconn);
+    fold(&evorder, eventptr->evtype * 2 + eventptr->eventity);
+    fold(&evorder, bits);
+  }
+  if (TRACE >= 2)
+  {
+    printf("\nEVENT time: %f,", UNITS(eventptr->evtime));
+    printf("  type: %d", eventptr->evtype);
+    if (eventptr->evtype == 0)
+      printf(", timerinterrupt  ");
+    else if (eventptr->evtype == 1)
+      printf(", fromlayer5 ");
+    else if (eventptr->evtype == 2)
+      printf(", fromlayer3 ");
+    else if (eventptr->evtype == TO_ROUTER)
+      printf(", torouter ");
+    else
+      printf(", fromrouter ");
+    printf(" entity: %d", eventptr->eventity);
+    c = hashfind(&conntable, eventptr->evconn);
+    if (nconns > 1)
+      printf(" conn: %d", c->id);
+    printf("\n");
+  }
+  return eventptr;
+}
+
+/* run the simulation until no events are left */
+void simulate(void)
+{
+  struct event *eventptr;
+  struct router *r;
+  struct msg msg2give;
+  struct pkt batch[MAXBATCH], *next;
+  struct conn *c;
+  void (*input_batch)(struct pkt *, int);
+
+  int i, j, n;
+
+  while ((eventptr = nextevent()) != NULL)
+  {
+    simtime = eventptr->evtime; /* update time to next event time */
+    c = hashfind(&conntable, eventptr->evconn);
+    switchto(c);
+    if (pdes > 0)
+      enterlp(eventlp(eventptr));
+    if (eventptr->evtype == TO_ROUTER)
+    {
+      torouter(hoprouter(c, eventptr), eventptr);
+      continue; /* the event lives on in the queue */
+    }
+    else if (eventptr->evtype == FROM_ROUTER)
+    {
+      r = hoprouter(c, eventptr);
+      routersent(r);
+      forward(r);
+      if (pdes > 0)
+      { /* the packet went on when it started */
+        slabfree(eventptr, sizeof(struct event));
+        continue;
+      }
+      if (++eventptr->evhop < eventroute(c, eventptr)->nhops)
+      { /* on to the next router */
+        torouter(hoprouter(c, eventptr), eventptr);
+        continue;
+      }
+      eventptr->evtype = FROM_LAYER3; /* and it arrives */
     }
-    time = eventptr->evtime; /* update time to next event time */
     if (eventptr->evtype == FROM_LAYER5)
     {
-      if (nsim < nsimmax)
+      if (c->nsim < c->nsimmax)
+      {
+        generate_next_arrival(c); /* set up future arrival */
+        /* fill in msg to give with string of same letter */
+        j = c->nsim % 26;
+        for (i = 0; i < 20; i++)
+          msg2give.data[i] = 97 + j;
+        if (TRACE > 2)
+        {
+          printf("          MAINLOOP: data given to student: ");
+          for (i = 0; i < 20; i++)
+            printf("%c", msg2give.data[i]);
+          printf("\n");
+        }
+        nsim++;
+        c->nsim++;
+        while (phase < nphases - 1 && nsim * nphases >= (phase + 1) * nsimmax)
+          nextphase();
+        n = c->stats.window_full;
+        if (eventptr->eventity == A)
+        {
+          c->proto->A_output(msg2give);
+          if (burst > 0 && c->stats.window_full == n)
+            msgtaken(c);
+        }
+        else
+          c->proto->B_output(msg2give);
+      }
+      else if (TRACE > 2)
+        printf("          FROM_LAYER5: no more messages to send: \n");
+    }
+    else if (eventptr->evtype == FROM_LAYER3)
+    {
+      /* the packets it brings, more than one when arrivals are rounded to
+         coincide: all at once to an entity that takes them together */
+      input_batch = eventptr->eventity == A ? c->proto->A_input_batch : c->proto->B_input_batch;
+      if (unbatched)
+        input_batch = NULL;
+      j = c->stats.new_ACKs;
+      while (eventptr->pktptr != NULL)
+      {
+        for (n = 0; n < MAXBATCH && eventptr->pktptr != NULL; n++)
+        {
+          next = ((struct netpkt *)eventptr->pktptr)->next;
+          batch[n] = arrival(c, eventptr);
+          eventptr->pktptr = next;
+        }
+        if (TRACE > 2 && n > 1)
+          printf("          MAINLOOP: %d packets given at once\n", n);
+        if (n > 1 && input_batch != NULL)
+          input_batch(batch, n);
+        else
+          for (i = 0; i < n; i++)
+            if (eventptr->eventity == A)   /* deliver packet by calling */
+              c->proto->A_input(batch[i]); /* appropriate entity */
+            else
+              c->proto->B_input(batch[i]);
+      }
+      if (eventptr->eventity == A && c->stats.new_ACKs != j)
+        c->streak = 0;
+    }
+    else if (eventptr->evtype == TIMER_INTERRUPT)
+    {
+      c->timer[eventptr->eventity] = NULL;
+      if (eventptr->eventity == A)
+      {
+        c->timeouts++;
+        if (++c->streak > c->maxstreak)
+          c->maxstreak = c->streak;
+        c->proto->A_timerinterrupt();
+      }
+      else
+        c->proto->B_timerinterrupt();
+    }
+    else
+    {
+      printf("INTERNAL PANIC: unknown event type \n");
+    }
+    slabfree(eventptr, sizeof(struct event));
+  }
+
+}
+
+/* what a worker thread simulated */
+struct shard
+{
+  int first, last; /* its connections, shardconns[first] up to shardconns[last - 1] */
+  int thread;      /* in parallel runs, its number */
+  counter nsim;
+  unsigned long long nevents;
+  clocktime endtime; /* of its last event */
+  size_t bytes;    /* memory it used */
+};
+
+/* a worker thread: simulate the connections of one shard with its own event
+   queue and slab pool, then give them back */
+void *runshard(void *arg)
+{
+  struct shard *sh = arg;
+  struct conn *c;
+  int i;
+
+  simtime = 0.0;
+  nsim = 0;
+  nevents = 0;
+  for (i = sh->first; i < sh->last; i++)
+  {
+    c = &conns[shardconns[i]];
+    switchto(c);
+    if (c->nsimmax > 0)
+      generate_next_arrival(c);
+  }
+  simulate();
+  sh->nsim = nsim;
+  sh->nevents = nevents;
+  sh->endtime = simtime;
+  sh->bytes = slabsize() + evsize();
+  evrelease();
+  slabrelease();
+  return NULL;
+}
+
+/* a worker thread of the parallel engine.  In every window the threads
+   take in the events posted to them, agree on the earliest pending event
+   and simulate their events up to a lookahead later: no event made in the
+   window can happen in another thread's processes before that.  Events
+   and packets are freed by the thread they end in; those of another
+   thread's pool go back to it, which takes them in after the window. */
+void *runlps(void *arg)
+{
+  struct shard *sh = arg;
+  struct outbox *o;
+  struct event *p;
+  clocktime start;
+  unsigned long i;
+  int t;
+
+  curthread = sh->thread;
+  simtime = 0.0;
+  nsim = 0;
+  nevents = 0;
+  firstarrivals(curthread);
+  while (1)
+  {
+    for (t = 0; t < pdes; t++)
+    {
+      o = &outboxes[t * pdes + curthread];
+      for (i = 0; i < o->n; i++)
+        evinsert(o->ev[i]);
+      o->n = 0;
+    }
+    p = evpeek();
+    nexttime[curthread] = p != NULL ? p->evtime : NEVER;
+    pthread_barrier_wait(&windowbarrier);
+    start = NEVER;
+    for (t = 0; t < pdes; t++)
+      if (nexttime[t] < start)
+        start = nexttime[t];
+    if (start == NEVER)
+      break;
+    if (curthread == 0)
+      windows++;
+    horizon = start + CLOCK(lookahead);
+    simulate();
+    pthread_barrier_wait(&windowbarrier); /* everything is posted, and freed */
+    slabdrain();
+  }
+  sh->nsim = nsim;
+  sh->nevents = nevents;
+  sh->endtime = simtime;
+  sh->bytes = slabsize() + evsize();
+  evrelease();
+  slabrelease();
+  return NULL;
+}
+
+/* start n worker threads and add up what they did in thread order */
+void runthreads(int n, void *(*work)(void *))
+{
+  pthread_t threads[MAXTHREADS];
+  struct shard shards[MAXTHREADS];
+  int t;
+
+  for (t = 0; t < n; t++)
+  {
+    shards[t].thread = t;
+    shards[t].first = shardstart[t];
+    shards[t].last = shardstart[t + 1];
+    if (pthread_create(&threads[t], NULL, work, &shards[t]) != 0)
+    {
+      printf("starting a worker thread failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (t = 0; t < n; t++)
+  {
+    pthread_join(threads[t], NULL);
+    nsim += shards[t].nsim;
+    nevents += shards[t].nevents;
+    if (shards[t].endtime > simtime)
+      simtime = shards[t].endtime;
+    shardbytes += shards[t].bytes;
+  }
+}
+
+/* run the logical processes on the threads of the parallel engine */
+void runparallel(void)
+{
+  int t;
+
+  outboxes = calloc((size_t)pdes * pdes, sizeof(struct outbox));
+  nexttime = malloc(pdes * sizeof(clocktime));
+  if (outboxes == NULL || nexttime == NULL)
+  {
+    printf("memory allocation for the parallel engine failed.");
+    exit(EXIT_FAILURE);
+  }
+  pthread_barrier_init(&windowbarrier, NULL, pdes);
+  windows = 0;
+  runthreads(pdes, runlps);
+  pthread_barrier_destroy(&windowbarrier);
+  for (t = 0; t < pdes * pdes; t++)
+    free(outboxes[t].ev);
+  free(outboxes);
+  free(nexttime);
+}
+
+/* run the simulation: on the worker threads in sharded and parallel runs,
+   or with the one event queue of the sequential engine */
+void run(void)
+{
+  struct conn *c;
+  int i;
+
+  if (nthreads > 0)
+    runthreads(nthreads, runshard);
+  else if (pdes > 1)
+    runparallel();
+  else
+    simulate();
+  if (pdes == 0)
+    return;
+  for (i = 0; i < nconns; i++)
+  { /* B's counts were kept apart */
+    c = &conns[i];
+    c->ntolayer3 += c->Bntolayer3;
+    c->nlost += c->Bnlost;
+    c->ncorrupt += c->Bncorrupt;
+  }
+}
+
+/* the flows of an incast run: what each got through the bottleneck, and
+   how often its sender timed out */
+void incastreport(void)
+{
+  struct conn *c;
+  double goodput, sum = 0.0, sumsq = 0.0, delay = 0.0;
+  int i, repeated = 0;
+  counter ndelayed = 0;
+
+  printf(" Simulator terminated at time %f\n", UNITS(simtime));
+  steadyreport();
+  if (nconns <= MAXLISTED)
+    printf("\nflow  host  delivered   goodput  timeouts  most in a row\n");
+  for (i = 0; i < nconns; i++)
+  {
+    c = &conns[i];
+    goodput = c->lastdelivery > warmedup ? c->messages_delivered / UNITS(c->lastdelivery - warmedup) : 0.0;
+    sum += goodput;
+    sumsq += goodput * goodput;
+    if (c->maxstreak >= 2)
+      repeated++;
+    delay += c->delay;
+    ndelayed += c->ndelayed;
+    if (nconns <= MAXLISTED)
+      printf("%4d  %4d  %9" COUNT "  %8.4f  %8" COUNT "  %13d\n", c->id, c->host[A], c->messages_delivered, goodput,
+             c->timeouts, c->maxstreak);
+  }
+  printf("aggregate goodput: %f messages per time unit\n", sum);
+  printf("Jain's fairness index: %f\n", sumsq > 0 ? sum * sum / (nconns * sumsq) : 0.0);
+  printf("flows with repeated timeouts: %d of %d\n", repeated, nconns);
+  printf("mean time of packets from A to B in the network: %f\n", ndelayed > 0 ? delay / ndelayed : 0.0);
+  routerreport();
+}
+
+/* incast: every sender sends to host 0 at once through the bottleneck.  The
+   workload is run with fixed and then with adaptive retransmission timeouts,
+   both times from the same random numbers. */
+void incastrun(void)
+{
+  for (adaptive_rto = 0; adaptive_rto <= 1; adaptive_rto++)
+  {
+    printf("\n%d senders into host 0, bottleneck %.3f packets per time unit, %s queue %d%s, %s timeout\n", incast,
+           bottleneckrate, disciplines[discipline], bottlenecklimit, ecn ? " with ECN" : "",
+           adaptive_rto ? "adaptive" : "fixed");
+    srand(9999);
+    setup();
+    run();
+    incastreport();
+  }
+}
+
+/* drop-based against ECN congestion signals: the workload is run with
+   congestion control twice from the same random numbers, first with the
+   routers dropping packets and then with them marking packets instead */
+void ecnrun(void)
+{
+  for (ecn = 0; ecn <= 1; ecn++)
+  {
+    printf("\n%s congestion signals\n", ecn ? "ECN" : "drop-based");
+    srand(9999);
+    setup();
+    run();
+    report();
+  }
+}
+
+/* rerun the simulation with ten times more connections each time, up to the
+   number asked for, and report how memory and speed scale.  The messages
+   are scaled with the connections so each carries the same load. */
+void benchmark(void)
+{
+  int maxconns = nconns;
+  counter maxmsgs = nsimmax;
+  double start, secs;
+  size_t bytes;
+
+  printf("\n  connections       events   events/sec  bytes/connection\n");
+  for (nconns = 1;; nconns = nconns < maxconns / 10 ? nconns * 10 : maxconns)
+  {
+    nsimmax = (counter)((double)maxmsgs * nconns / maxconns);
+    start = wallclock();
+    setup();
+    run();
+    secs = wallclock() - start;
+    bytes = slabsize() + evsize() + shardbytes;
+    printf("%13d %12llu %12.0f %17.1f\n", nconns, nevents, nevents / (secs > 0 ? secs : 1e-9),
+           (double)bytes / nconns);
+    fflush(stdout);
+    if (nconns == maxconns)
+      break;
+  }
+}
+
+/* a fingerprint of the results of a run */
+unsigned long long digest(void)
+{
+  unsigned long long h = 0, v[16];
+  double t;
+  struct conn *c;
+  struct router *r;
+  int i, k;
+
+  for (i = 0; i < nconns; i++)
+  {
+    c = &conns[i];
+    v[0] = c->nsim;
+    v[1] = c->stats.total_ACKs_received;
+    v[2] = c->stats.packets_resent;
+    v[3] = c->stats.new_ACKs;
+    v[4] = c->stats.packets_received;
+    v[5] = c->stats.window_full;
+    v[6] = c->messages_delivered;
+    v[7] = c->ntolayer3;
+    v[8] = c->nlost;
+    v[9] = c->ncorrupt;
+    v[10] = c->timeouts;
+    v[11] = c->maxstreak;
+    v[12] = c->ndelayed;
+    t = UNITS(c->lastdelivery);
+    memcpy(&v[13], &t, sizeof(t));
+    memcpy(&v[14], &c->delay, sizeof(c->delay));
+    for (k = 0; k < 15; k++)
+      fold(&h, v[k]);
+  }
+  for (i = 0; i < nrouters; i++)
+  {
+    r = &routers[i];
+    v[0] = r->arrivals;
+    v[1] = r->drops;
+    v[2] = r->marks;
+    v[3] = r->maxlength;
+    for (k = 0; k < 4; k++)
+      fold(&h, v[k]);
+  }
+  t = UNITS(simtime);
+  memcpy(&v[0], &t, sizeof(t));
+  fold(&h, v[0]);
+  return h;
+}
+
+/* run the workload with each event queue, and report how fast each is
+   and whether they all simulate the events in the same order */
+void queuebenchmark(void)
+{
+  static const char *names[] = {"list", "heap", "fifo"};
+  unsigned long long first = 0;
+  double start, secs;
+
+  printf("\n  queue       events   events/sec  same order\n");
+  checkorder = 1;
+  for (evqueue = EVLIST; evqueue <= EVFIFO; evqueue++)
+  {
+    srand(9999);
+    evorder = 0;
+    start = wallclock();
+    setup();
+    run();
+    secs = wallclock() - start;
+    if (evqueue == EVLIST)
+      first = evorder;
+    printf("%7s %12llu %12.0f  %s\n", names[evqueue], nevents, nevents / (secs > 0 ? secs : 1e-9),
+           evorder == first ? "yes" : "no");
+    fflush(stdout);
+  }
+}
+
+/* rerun the parallel engine on 1, 2, 4, ... threads up to the number asked
+   for, and report how it scales and whether every run gives the results of
+   the run on one thread */
+void pdesbenchmark(void)
+{
+  int maxthreads = pdes;
+  unsigned long long first = 0, d;
+  double start, secs, base = 0.0;
+
+  printf("\n  threads       events    windows   events/sec  speedup  same\n");
+  for (pdes = 1;; pdes = pdes < maxthreads / 2 ? pdes * 2 : maxthreads)
+  {
+    start = wallclock();
+    setup();
+    run();
+    secs = wallclock() - start;
+    if (secs <= 0)
+      secs = 1e-9;
+    d = digest();
+    if (pdes == 1)
+    {
+      first = d;
+      base = secs;
+      windows = 0;
+    }
+    printf("%9d %12llu %10lu %12.0f %8.2f  %s\n", pdes, nevents, windows, nevents / secs, base / secs,
+           d == first ? "yes" : "no");
+    fflush(stdout);
+    if (pdes == maxthreads)
+      break;
+  }
+}
+
+/* run the workload once, however many messages it has, sampling the memory
+   held every SOAKEVERY events, and check that it stays flat after the
+   first sample: every event frees what it took, so a run of a billion
+   messages needs no more than one of a million.  That holds while the
+   channels keep up with the load; an overloaded channel's backlog grows
+   without bound, and the run reports it.  A run over before the first
+   sample has only the one at its end, and nothing to compare it with. */
+void soakrun(void)
+{
+  size_t bytes;
+  long rss;
+
+  printf("\n       events         time       messages  pool bytes      rss kB   seconds\n");
+  soakstart = wallclock();
+  setup();
+  run();
+  soaksample();
+  if (soaksamples < 2)
+  {
+    printf("memory after the first sample: too short to tell, %llu events of the %llu to a sample\n", nevents,
+           SOAKEVERY);
+    return;
+  }
+  bytes = slabsize() + evsize();
+  rss = residentkb();
+  printf("memory after the first sample: pool %+ld bytes, resident set %+ld kB, %s\n",
+         (long)bytes - (long)soakbytes, rss - soakrss,
+         bytes <= soakbytes * (1 + SOAKSLACK) && rss <= soakrss * (1 + SOAKSLACK) + SOAKRSSKB ? "flat" : "growing");
+}
+
+/* the delay within which 99 of every 100 packets reached B in the run */
+double p99delay(void)
+{
+  unsigned long n = 0, k = 0;
+  int b;
+
+  for (b = 0; b < HISTBINS; b++)
+    n += delayhist[b];
+  for (b = 0; b < HISTBINS; b++)
+    if ((k += delayhist[b]) * 100 >= n * 99)
+      return binlimit(b);
+  return 0.0;
+}
+
+/* the key of replicate i in the result cache: the program, which stands
+   for the protocols it was built with, every parameter a run depends on
+   and the seed */
+unsigned long long runkey(int i)
+{
+  unsigned long long h = buildkey;
+  double f[] = {lossprob, corruptprob, lambda, rto_initial, warmat, tolerance, lossbias, bottleneckrate, quantum};
+  long long n[] = {nsimmax, corruptdirection, TRACE, nhosts, nconns, evqueue, adaptive_rto, congestion_control,
+                   ecn, window_limit, discipline, warmup, incast, bottlenecklimit, rack, gbn_buffering, unbatched, i};
+
+  foldbytes(&h, protocol->name, strlen(protocol->name));
+  foldbytes(&h, f, sizeof(f));
+  foldbytes(&h, n, sizeof(n));
+  return h;
+}
+
+/* a replicate: the run with seed 9999 + i, or from a snapshot with a random
+   number stream of its own, in a child process that sends back what it
+   measured through a pipe.  Replicate 0 is the run there would be without
+   replicates.  One found in the result cache is not run: its result is
+   left in *r and the process id given is 0. */
+pid_t spawnreplicate(int i, int *fd, struct replicate *cached)
+{
+  struct replicate r;
+  counter delivered = 0;
+  unsigned long long key = cachedir != NULL ? runkey(i) : 0;
+  int p[2], j;
+  pid_t pid;
+
+  cacheruns++;
+  if (cachedir != NULL && cacheget(key, cached, sizeof(*cached)))
+  {
+    cachehits++;
+    *fd = -1;
+    return 0;
+  }
+  fflush(stdout);
+  if (pipe(p) != 0 || (pid = fork()) < 0)
+  {
+    printf("starting replicate %d failed\n", i);
+    exit(EXIT_FAILURE);
+  }
+  if (pid > 0)
+  {
+    close(p[1]);
+    *fd = p[0];
+    return pid;
+  }
+  close(p[0]);
+  if (i > 0)
+    srand(9999 + i);
+  if (loadfile != NULL)
+  {
+    loadsnapshot();
+    if (i > 0)
+      seqrng = SHARDSEED + i;
+  }
+  else
+    setup();
+  run();
+  for (j = 0; j < nconns; j++)
+    delivered += conns[j].messages_delivered;
+  r.goodput = simtime > warmedup ? delivered / UNITS(simtime - warmedup) : 0.0;
+  r.p99 = p99delay();
+  r.weight = exp(logweight);
+  r.maxstreak = 0;
+  for (j = 0; j < nconns; j++)
+    if (conns[j].maxstreak > r.maxstreak)
+      r.maxstreak = conns[j].maxstreak;
+  memcpy(r.hist, delayhist, sizeof(r.hist));
+  if (cachedir != NULL)
+    cacheput(key, &r, sizeof(r));
+  if (write(p[1], &r, sizeof(r)) != sizeof(r))
+    _exit(EXIT_FAILURE);
+  _exit(EXIT_SUCCESS); /* leaving the parent's buffered output alone */
+}
+
+/* half the width of the 95% confidence interval of the mean of n values
+   with the given sum and sum of squares, from Student's t distribution */
+double halfwidth(double sum, double sumsq, int n)
+{
+  static const double t[] = {0,      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                             2.201,  2.179,  2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086, 2.080,
+                             2.074,  2.069,  2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  double var = (sumsq - sum * sum / n) / (n - 1);
+
+  return (n - 1 <= 30 ? t[n - 1] : 1.96) * sqrt(var > 0 ? var / n : 0.0);
+}
+
+/* wait for one of the replicates started so far to finish, and take in
+   what it measured; returns its number.  Those from the cache are taken
+   first.  A replicate taken in has its process id set to -1. */
+int reapreplicate(pid_t *pid, int *fd, int started, struct replicate *r)
+{
+  pid_t child;
+  int status, i;
+
+  for (i = 0; i < started; i++)
+    if (pid[i] == 0)
+    {
+      pid[i] = -1;
+      return i;
+    }
+  do
+  {
+    child = wait(&status);
+    for (i = 0; i < started && pid[i] != child; i++)
+      ;
+  } while (child > 0 && i == started);
+  if (child < 0 || read(fd[i], &r[i], sizeof(r[i])) != sizeof(r[i]))
+  {
+    printf("replicate %d failed\n", i);
+    exit(EXIT_FAILURE);
+  }
+  close(fd[i]);
+  pid[i] = -1;
+  return i;
+}
+
+/* the delay within which the given part of the packets reached B, from a
+   histogram weighed by importance sampling */
+double weightedquantile(const double *hist, double q)
+{
+  double n = 0.0, k = 0.0;
+  int b;
+
+  for (b = 0; b < HISTBINS; b++)
+    n += hist[b];
+  for (b = 0; b < HISTBINS; b++)
+    if ((k += hist[b]) >= q * n && n > 0)
+      return binlimit(b);
+  return 0.0;
+}
+
+/* run replicates, repprocs at a time, until the confidence intervals of
+   both measurements are narrower than repwidth of their means.  They are
+   judged in the order of their seeds, so the outcome is the same however
+   many run at once; any run beyond it are stopped.  With importance
+   sampling every replicate counts as much as its likelihood ratio, and the
+   second measurement is the chance of a sender timing out RARESTREAK
+   times in a row. */
+void replicaterun(void)
+{
+  struct replicate *r = malloc(REPMAX * sizeof(struct replicate));
+  pid_t *pid = malloc(REPMAX * sizeof(pid_t));
+  int *fd = malloc(REPMAX * sizeof(int));
+  char *done = calloc(REPMAX, 1);
+  double *whist = calloc(HISTBINS, sizeof(double));
+  double gsum = 0.0, gsq = 0.0, psum = 0.0, psq = 0.0, gw = 0.0, pw = 0.0, g, x, w;
+  double wsum = 0.0, wsq = 0.0, streaks[STREAKS + 1] = {0}, streaksq[STREAKS + 1] = {0};
+  int started = 0, running = 0, n = 0, converged = 0, status, i, k;
+
+  if (r == NULL || pid == NULL || fd == NULL || done == NULL || whist == NULL)
+  {
+    printf("memory allocation for the replicates failed.");
+    exit(EXIT_FAILURE);
+  }
+  if (lossbias > 0)
+    printf("\nreplicate      goodput    p99 delay  likelihood ratio  most in a row\n");
+  else
+    printf("\nreplicate      goodput    p99 delay\n");
+  while (!converged && n < REPMAX)
+  {
+    while (running < repprocs && started < REPMAX)
+    {
+      pid[started] = spawnreplicate(started, &fd[started], &r[started]);
+      started++;
+      running++;
+    }
+    i = reapreplicate(pid, fd, started, r);
+    running--;
+    done[i] = 1;
+    while (!converged && n < started && done[n])
+    {
+      w = lossbias > 0 ? r[n].weight : 1.0;
+      g = w * r[n].goodput;
+      if (lossbias > 0)
       {
-        generate_next_arrival(); /* set up future arrival */
-        /* fill in msg to give with string of same letter */
-        j = nsim % 26;
-        for (i = 0; i < 20; i++)
-          msg2give.data[i] = 97 + j;
-        if (TRACE > 2)
+        printf("%9d %12.6f %12.3f %17.6g %14d\n", n, r[n].goodput, r[n].p99, w, r[n].maxstreak);
+        x = r[n].maxstreak >= RARESTREAK ? w : 0.0;
+      }
+      else
+      {
+        printf("%9d %12.6f %12.3f\n", n, r[n].goodput, r[n].p99);
+        x = r[n].p99;
+      }
+      gsum += g;
+      gsq += g * g;
+      psum += x;
+      psq += x * x;
+      wsum += w;
+      wsq += w * w;
+      for (k = 1; k <= STREAKS && r[n].maxstreak >= k; k++)
+      {
+        streaks[k] += w;
+        streaksq[k] += w * w;
+      }
+      for (k = 0; k < HISTBINS; k++)
+        whist[k] += w * r[n].hist[k];
+      n++;
+      if (n < REPMIN)
+        continue;
+      gw = halfwidth(gsum, gsq, n);
+      pw = halfwidth(psum, psq, n);
+      converged = gw <= repwidth * gsum / n && pw <= repwidth * psum / n && (lossbias == 0 || psum > 0);
+    }
+    fflush(stdout);
+  }
+  for (i = 0; i < started; i++)
+    if (pid[i] > 0)
+    {
+      kill(pid[i], SIGKILL);
+      waitpid(pid[i], &status, 0);
+      close(fd[i]);
+    }
+  printf("goodput: %f +- %f messages per time unit\n", gsum / n, gw);
+  if (lossbias > 0)
+  {
+    printf("chance that a sender times out so many times in a row, with losses drawn at %g instead of %g:\n",
+           lossbias, lossprob);
+    for (k = 1; k <= STREAKS; k++)
+      printf("%9d %12.6g +- %g\n", k, streaks[k] / n, halfwidth(streaks[k], streaksq[k], n));
+    printf("delay of packets from A to B: 99th percentile %f, 99.9th %f, 99.99th %f\n",
+           weightedquantile(whist, 0.99), weightedquantile(whist, 0.999), weightedquantile(whist, 0.9999));
+    printf("effective number of replicates: %.1f\n", wsq > 0 ? wsum * wsum / wsq : 0.0);
+  }
+  else
+    printf("99th percentile of the delay of packets from A to B: %f +- %f\n", psum / n, pw);
+  printf("95%% confidence intervals from %d replicates, %swithin %g of the means\n", n,
+         converged ? "" : "not ", repwidth);
+  if (cachedir != NULL)
+    printf("%d of %d replicates answered from the cache\n", cachehits, cacheruns);
+  free(r);
+  free(pid);
+  free(fd);
+  free(done);
+  free(whist);
+}
+
+/* the optimizer's measure of a candidate: its goodput if its delay is in
+   bounds, and any candidate in bounds beats those that are not */
+double score(double goodput, double p99)
+{
+  return p99 <= delaybound ? goodput : -p99;
+}
+
+/* run OPTREPS replicates of the workload with the senders tuned as given,
+   repprocs at a time and with the seeds of every other candidate, and
+   give their mean goodput and 99th percentile of the delay */
+double evaluate(const struct protocol *p, int window, double rto, double *goodput, double *p99)
+{
+  static struct replicate r[OPTREPS];
+  pid_t pid[OPTREPS];
+  int fd[OPTREPS];
+  int started = 0, finished = 0, i;
+
+  protocol = p;
+  window_limit = window;
+  rto_initial = rto;
+  while (finished < OPTREPS)
+  {
+    while (started < OPTREPS && started - finished < repprocs)
+    {
+      pid[started] = spawnreplicate(started, &fd[started], &r[started]);
+      started++;
+    }
+    reapreplicate(pid, fd, started, r);
+    finished++;
+  }
+  *goodput = *p99 = 0.0;
+  for (i = 0; i < OPTREPS; i++)
+  {
+    *goodput += r[i].goodput / OPTREPS;
+    *p99 += r[i].p99 / OPTREPS;
+  }
+  printf("%-8s %6d %8.3f %12.6f %12.3f%s\n", p->name, window, rto, *goodput, *p99,
+         *p99 <= delaybound ? "" : "  over the bound");
+  fflush(stdout);
+  return score(*goodput, *p99);
+}
+
+/* search every protocol and window, and for each the timeout by golden
+   section between OPTMINRTO and OPTMAXRTO, for the candidate with the
+   most goodput whose 99th percentile of the delay is within delaybound */
+void optimize(void)
+{
+  const double phi = 0.6180339887498949;
+  const struct protocol *bestp = NULL;
+  double a, b, x1, x2, f1, f2, g, d, best = -INFINITY, bestrto = 0.0, bestg = 0.0, bestd = 0.0;
+  int i, w, k, bestw = 0, modelled = nconns == 1 && nrouters == 0 && !congestion_control && !adaptive_rto;
+
+  printf("\nprotocol window  timeout      goodput    p99 delay\n");
+  for (i = 0; protocols[i] != NULL; i++)
+    for (w = 1; w <= protocols[i]->window; w++)
+    {
+      /* the model's goodput falls with the timeout: at the shortest, well
+         short of the best in bounds, there is nothing to search for */
+      g = throughputmodel(protocols[i]->resend, w, OPTMINRTO, &d);
+      if (modelled && !protocols[i]->adapts && bestd <= delaybound && g * (1 + MODELTOL) < bestg)
+      {
+        printf("%-8s %6d   pruned: at most %f by the throughput model\n", protocols[i]->name, w, g);
+        continue;
+      }
+      a = OPTMINRTO;
+      b = OPTMAXRTO;
+      x1 = b - phi * (b - a);
+      x2 = a + phi * (b - a);
+      f1 = evaluate(protocols[i], w, x1, &g, &d);
+      if (f1 > best)
+      {
+        best = f1, bestp = protocols[i], bestw = w, bestrto = x1, bestg = g, bestd = d;
+      }
+      f2 = evaluate(protocols[i], w, x2, &g, &d);
+      for (k = 0;; k++)
+      {
+        if (f2 > best)
         {
-          printf("          MAINLOOP: data given to student: ");
-          for (i = 0; i < 20; i++)
-            printf("%c", msg2give.data[i]);
-          printf("\n");
+          best = f2, bestp = protocols[i], bestw = w, bestrto = x2, bestg = g, bestd = d;
+        }
+        if (k == OPTSTEPS)
+          break;
+        if (f1 < f2)
+        { /* the best timeout is above x1 */
+          a = x1;
+          x1 = x2;
+          f1 = f2;
+          x2 = a + phi * (b - a);
+          f2 = evaluate(protocols[i], w, x2, &g, &d);
         }
-        nsim++;
-        if (eventptr->eventity == A)
-          A_output(msg2give);
         else
-          B_output(msg2give);
+        { /* or below x2 */
+          b = x2;
+          x2 = x1;
+          f2 = f1;
+          x1 = b - phi * (b - a);
+          f1 = evaluate(protocols[i], w, x1, &g, &d);
+          if (f1 > best)
+          {
+            best = f1, bestp = protocols[i], bestw = w, bestrto = x1, bestg = g, bestd = d;
+          }
+        }
       }
-      else if (TRACE > 2)
-        printf("          FROM_LAYER5: no more messages to send: \n");
     }
-    else if (eventptr->evtype == FROM_LAYER3)
+  if (bestd > delaybound)
+    printf("no candidate keeps the 99th percentile of the delay within %f; the nearest:\n", delaybound);
+  printf("best: -p %s, window %d, timeout %.3f: goodput %f, 99th percentile of the delay %f\n", bestp->name, bestw,
+         bestrto, bestg, bestd);
+  if (cachedir != NULL)
+    printf("%d of %d replicates answered from the cache\n", cachehits, cacheruns);
+}
+
+/* tail latency: the workload, short bursts of messages with longer gaps
+   between them, is run twice from the same random numbers, first with the
+   senders waiting for their retransmission timeouts and then with loss
+   detection by time and tail loss probes.  Only a timeout or a probe
+   recovers a loss at the end of a burst, when no ACKs follow to show it. */
+void tailrun(void)
+{
+  double mean, p99[2], p999[2];
+  counter n, timeouts;
+  int i;
+
+  latencies = malloc(nconns * sizeof(struct latency));
+  for (rack = 0; rack <= 1; rack++)
+  {
+    printf("\nbursts of %d messages, %s\n", burst,
+           rack ? "loss detection by time and tail loss probes" : "retransmission timeouts only");
+    srand(9999);
+    memset(latencies, 0, nconns * sizeof(struct latency));
+    memset(msghist, 0, sizeof(msghist));
+    msgsum = 0.0;
+    rackprobes = racklosses = 0;
+    setup();
+    run();
+    report();
+    for (n = 0, i = 0; i < HISTBINS; i++)
+      n += msghist[i];
+    for (timeouts = 0, i = 0; i < nconns; i++)
+      timeouts += conns[i].timeouts;
+    mean = n > 0 ? msgsum / n : 0.0;
+    p99[rack] = weightedquantile(msghist, 0.99);
+    p999[rack] = weightedquantile(msghist, 0.999);
+    printf("timeouts: %" COUNT ", probes: %" COUNT ", packets found lost by time: %" COUNT "\n", timeouts - rackprobes,
+           rackprobes, racklosses);
+    printf("message latency: mean %f, median %f, 99th percentile %f, 99.9th percentile %f\n", mean,
+           weightedquantile(msghist, 0.5), p99[rack], p999[rack]);
+  }
+  printf("\ntail latency with probes: 99th percentile %+.1f%%, 99.9th percentile %+.1f%%\n",
+         p99[0] > 0 ? 100 * (p99[1] / p99[0] - 1) : 0.0, p999[0] > 0 ? 100 * (p999[1] / p999[0] - 1) : 0.0);
+  free(latencies);
+}
+
+/* a go-back-N receiver holding packets out of order against one
+   discarding them: the workload is run twice from the same random numbers,
+   and the resends and the packets sent into the network, both ways, per
+   message delivered are reported for both */
+void bufferingrun(void)
+{
+  counter resent[2], sent[2], delivered[2];
+  double perdelivered[2][2]; /* resends and packets sent per message delivered */
+  int i;
+
+  for (gbn_buffering = 0; gbn_buffering <= 1; gbn_buffering++)
+  {
+    printf("\ngo-back-N receivers %s packets out of order\n", gbn_buffering ? "holding" : "discarding");
+    srand(9999);
+    setup();
+    run();
+    report();
+    resent[gbn_buffering] = sent[gbn_buffering] = delivered[gbn_buffering] = 0;
+    for (i = 0; i < nconns; i++)
     {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i = 0; i < 20; i++)
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-      if (eventptr->eventity == A) /* deliver packet by calling */
-        A_input(pkt2give);         /* appropriate entity */
-      else
-        B_input(pkt2give);
-      free(eventptr->pktptr); /* free the memory for packet */
+      resent[gbn_buffering] += conns[i].stats.packets_resent;
+      sent[gbn_buffering] += conns[i].ntolayer3;
+      delivered[gbn_buffering] += conns[i].messages_delivered;
     }
-    else if (eventptr->evtype == TIMER_INTERRUPT)
+    perdelivered[gbn_buffering][0] = delivered[gbn_buffering] > 0 ? (double)resent[gbn_buffering] / delivered[gbn_buffering] : 0.0;
+    perdelivered[gbn_buffering][1] = delivered[gbn_buffering] > 0 ? (double)sent[gbn_buffering] / delivered[gbn_buffering] : 0.0;
+  }
+  printf("\nholding packets out of order: %+" COUNT " messages delivered, per message delivered %.3f packets\n"
+         "resent instead of %.3f (%+.1f%%) and %.3f sent both ways instead of %.3f (%+.1f%%)\n",
+         delivered[1] - delivered[0], perdelivered[1][0], perdelivered[0][0],
+         perdelivered[0][0] > 0 ? 100 * perdelivered[1][0] / perdelivered[0][0] - 100 : 0.0, perdelivered[1][1],
+         perdelivered[0][1], perdelivered[0][1] > 0 ? 100 * perdelivered[1][1] / perdelivered[0][1] - 100 : 0.0);
+}
+
+/* a scenario: the messages are split into nphases phases, each with a
+   loss probability of its own, and the run is made with go-back-N,
+   selective repeat and the hybrid from the same random numbers.  The
+   goodput of each phase is reported for the three, and how close the
+   hybrid came to the better of the other two.  With the fixed timeout, a
+   lossy phase can leave go-back-N resending whole windows faster than
+   its channel carries them.  The backlog then outgrows the timeout, and
+   go-back-N stays stalled through the later phases, as the original
+   sender does; the better protocol is then selective repeat.  With -r
+   go-back-N recovers. */
+void scenariorun(void)
+{
+  static const struct protocol *const compared[] = {&gbn_protocol, &sr_protocol, &hybrid_protocol};
+  double goodput[3][MAXPHASES], t, best, sum = 0.0, sumbest = 0.0;
+  counter resent;
+  int i, k;
+
+  for (i = 0; i < 3; i++)
+  {
+    protocol = compared[i];
+    srand(9999);
+    phase = 0;
+    lossprob = losses[0];
+    modeswitches = 0;
+    memset(phasedelivered, 0, sizeof(phasedelivered));
+    setup();
+    phasestart[0] = simtime;
+    phaseswitches[0] = 0;
+    run();
+    for (resent = 0, k = 0; k < nconns; k++)
+      resent += conns[k].stats.packets_resent;
+    printf("%-6s  %" COUNT " messages delivered, %" COUNT " packets resent, ended at time %f\n", protocol->name,
+           ndelivered, resent, UNITS(simtime));
+    for (k = 0; k < nphases; k++)
     {
-      if (eventptr->eventity == A)
-        A_timerinterrupt();
+      t = UNITS((k + 1 < nphases ? phasestart[k + 1] : simtime) - phasestart[k]);
+      goodput[i][k] = t > 0 ? phasedelivered[k] / t : 0.0;
+    }
+  }
+
+  printf("\nphase   loss       gbn        sr    hybrid  switches  of the better\n");
+  for (k = 0; k < nphases; k++)
+  {
+    best = goodput[0][k] > goodput[1][k] ? goodput[0][k] : goodput[1][k];
+    sum += goodput[2][k];
+    sumbest += best;
+    printf("%5d  %5.3f  %8.5f  %8.5f  %8.5f  %8" COUNT "  %12.1f%%\n", k, losses[k], goodput[0][k], goodput[1][k],
+           goodput[2][k], (k + 1 < nphases ? phaseswitches[k + 1] : modeswitches) - phaseswitches[k],
+           best > 0 ? 100 * goodput[2][k] / best : 0.0);
+  }
+  printf("the hybrid got %.1f%% of the goodput of the better protocol of each phase\n",
+         sumbest > 0 ? 100 * sum / sumbest : 0.0);
+}
+
+/* read the loss probabilities of the phases of a scenario, separated by
+   commas; the number of them, or 0 if they do not make sense */
+int parselosses(const char *s)
+{
+  char *end;
+  int n;
+
+  for (n = 0; n < MAXPHASES; n++)
+  {
+    losses[n] = strtod(s, &end);
+    if (end == s || losses[n] < 0 || losses[n] >= 1)
+      return 0;
+    if (*end == '\0')
+      return n + 1;
+    if (*end != ',')
+      return 0;
+    s = end + 1;
+  }
+  return 0;
+}
+
+/* check the options go together: at most one run mode in place of the
+   ordinary run, given only with settings it takes */
+void checkoptions(int argc, int bench, int queues)
+{
+  struct runmode modes[] = {
+      {bench, SETPARALLEL | SETSHARDED | SETCONNFILE | SETECN | SETBUFFERING},           /* -B */
+      {soak, SETCONNFILE | SETECN | SETBUFFERING},                                      /* -S */
+      {repwidth > 0, SETRESUME | SETBIAS | SETCONNFILE | SETECN | SETBUFFERING},        /* -m */
+      {delaybound > 0, SETCONNFILE | SETECN | SETBUFFERING},                            /* -O */
+      {buffercompare, SETCONNFILE | SETECN},                                            /* -g */
+      {nphases > 0, SETECN | SETBUFFERING},                                             /* -v */
+      {burst > 0, SETCONNFILE | SETECN | SETBUFFERING},                                 /* -l */
+      {incast != 0, SETPARALLEL | SETSHARDED | SETECN | SETBUFFERING},                  /* -I */
+      {ecncompare, SETPARALLEL | SETSHARDED | SETCONNFILE | SETBUFFERING},              /* -e */
+  };
+  int settings, given = 0, i;
+
+  settings = (snapfile != NULL ? SETSNAPSHOT : 0) | (loadfile != NULL ? SETRESUME : 0) | (pdes ? SETPARALLEL : 0) |
+             (nthreads ? SETSHARDED : 0) | (lossbias > 0 ? SETBIAS : 0) | (connfile != NULL ? SETCONNFILE : 0) |
+             (ecn ? SETECN : 0) | (gbn_buffering ? SETBUFFERING : 0);
+  for (i = 0; i < (int)(sizeof(modes) / sizeof(modes[0])); i++)
+    if (modes[i].given)
+    {
+      given++;
+      if ((settings & ~modes[i].takes) != 0)
+        usage();
+    }
+
+  if (given > 1 || nhosts < 1 || nhosts > MAXHOSTS || nconns < 1 || optind != argc ||
+      (bench && connfile != NULL && !pdes) || nthreads < 0 || nthreads > MAXTHREADS || pdes < 0 ||
+      pdes > MAXTHREADS || (pdes && nthreads) || (pdes && evqueue != EVHEAP) || (queues && (!bench || pdes || nthreads)) ||
+      (snapfile != NULL) != (snapat >= 0) || ((snapfile != NULL || loadfile != NULL) && (pdes || nthreads)) ||
+      ((warmup || tolerance > 0) && (pdes || nthreads)) || repprocs < 1 || lossbias < 0 ||
+      (lossbias > 0 && (pdes || nthreads || snapfile != NULL)) ||
+      (repprocs > 1 && repwidth == 0 && delaybound == 0) || (invalidate && cachedir == NULL) ||
+      (unbatched && quantum == 0) || (cachedir != NULL && repwidth == 0 && delaybound == 0 && !invalidate))
+    usage();
+}
+
+int main(int argc, char **argv)
+{
+  int opt, bench = 0, queues = 0;
+
+  while ((opt = getopt(argc, argv, "n:c:f:p:q:BSrFGgCEet:D:I:R:Q:j:P:W:T:L:w:s:m:k:b:O:M:Xl:v:A:U")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      nhosts = atoi(optarg);
+      break;
+    case 'c':
+      nconns = atoi(optarg);
+      break;
+    case 'f':
+      connfile = optarg;
+      break;
+    case 'p':
+      protocol = findprotocol(optarg);
+      break;
+    case 'q':
+      if (strcmp(optarg, "list") == 0)
+        evqueue = EVLIST;
+      else if (strcmp(optarg, "heap") == 0)
+        evqueue = EVHEAP;
+      else if (strcmp(optarg, "fifo") == 0)
+        evqueue = EVFIFO;
+      else if (strcmp(optarg, "all") == 0)
+        queues = 1;
       else
-        B_timerinterrupt();
+        usage();
+      break;
+    case 'B':
+      bench = 1;
+      break;
+    case 'S':
+      soak = 1;
+      break;
+    case 'W':
+      snapfile = optarg;
+      break;
+    case 'T':
+      snapat = atof(optarg);
+      break;
+    case 'L':
+      loadfile = optarg;
+      break;
+    case 'w':
+      warmup = strcmp(optarg, "mser") == 0 ? WARMMSER : WARMTIME;
+      warmat = atof(optarg);
+      if (warmup == WARMTIME && warmat <= 0)
+        usage();
+      break;
+    case 's':
+      tolerance = atof(optarg);
+      if (tolerance <= 0)
+        usage();
+      break;
+    case 'm':
+      repwidth = atof(optarg);
+      if (repwidth <= 0)
+        usage();
+      break;
+    case 'k':
+      repprocs = atoi(optarg);
+      break;
+    case 'b':
+      lossbias = atof(optarg);
+      break;
+    case 'O':
+      delaybound = atof(optarg);
+      if (delaybound <= 0)
+        usage();
+      break;
+    case 'M':
+      cachedir = optarg;
+      break;
+    case 'X':
+      invalidate = 1;
+      break;
+    case 'r':
+      adaptive_rto = 1;
+      break;
+    case 'F':
+      rack = 1;
+      break;
+    case 'G':
+      gbn_buffering = 1;
+      break;
+    case 'g':
+      buffercompare = 1;
+      break;
+    case 'l':
+      burst = atoi(optarg);
+      if (burst < 1)
+        usage();
+      break;
+    case 'v':
+      nphases = parselosses(optarg);
+      if (nphases == 0)
+        usage();
+      break;
+    case 'A':
+      quantum = atof(optarg);
+      if (quantum <= 0)
+        usage();
+      break;
+    case 'U':
+      unbatched = 1;
+      break;
+    case 'j':
+      nthreads = atoi(optarg);
+      break;
+    case 'P':
+      pdes = atoi(optarg);
+      break;
+    case 'C':
+      congestion_control = 1;
+      break;
+    case 'E':
+      congestion_control = 1;
+      ecn = 1;
+      break;
+    case 'e':
+      congestion_control = 1;
+      ecncompare = 1;
+      break;
+    case 't':
+      topofile = optarg;
+      break;
+    case 'D':
+      discipline = finddiscipline(optarg);
+      break;
+    case 'I':
+      incast = atoi(optarg);
+      nhosts = incast + 1;
+      nconns = incast;
+      break;
+    case 'R':
+      bottleneckrate = atof(optarg);
+      break;
+    case 'Q':
+      bottlenecklimit = atoi(optarg);
+      break;
+    default:
+      usage();
     }
-    else
+  }
+  checkoptions(argc, bench, queues);
+  if (cachedir != NULL)
+  {
+    if (!cacheopen(cachedir))
     {
-      printf("INTERNAL PANIC: unknown event type \n");
+      printf("the result cache %s can't be used\n", cachedir);
+      return EXIT_FAILURE;
     }
-    free(eventptr);
+    if (invalidate)
+      printf("%d results removed from the cache\n", cacheclear());
+    if (repwidth == 0 && delaybound == 0)
+      return EXIT_SUCCESS;
+    foldfile(&buildkey, "/proc/self/exe");
+    foldfile(&buildkey, connfile);
+    foldfile(&buildkey, topofile);
+    foldfile(&buildkey, loadfile);
   }
+  if (snapfile != NULL)
+    snaptime = CLOCK(snapat);
+  evstamp = pdes > 0;
+  if (incast != 0 && (incast < 1 || nconns != incast || connfile != NULL || topofile != NULL || bench ||
+                      bottleneckrate <= 0 ||
+                      bottlenecklimit < 1))
+    usage();
 
-terminate:
-  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n", time, nsim);
-  printf("number of messages dropped due to full window:  %d \n", window_full);
-  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
-  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
-  printf("number of packet resends by A:  %d \n", packets_resent);
-  printf("number of correct packets received at B:  %d \n", packets_received);
-  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  init();
+  if (lossbias > 0)
+  {
+    if (lossprob <= 0 || lossbias <= lossprob || lossbias >= 1)
+    {
+      printf("losses can only be drawn at a probability between the loss probability and 1\n");
+      return EXIT_FAILURE;
+    }
+    lostweight = log(lossprob / lossbias);
+    keptweight = log((1 - lossprob) / (1 - lossbias));
+  }
+  if (queues)
+  {
+    queuebenchmark();
+    return EXIT_SUCCESS;
+  }
+  if (bench && pdes)
+  {
+    pdesbenchmark();
+    return EXIT_SUCCESS;
+  }
+  if (bench)
+  {
+    benchmark();
+    return EXIT_SUCCESS;
+  }
+  if (soak)
+  {
+    soakrun();
+    return EXIT_SUCCESS;
+  }
+  if (repwidth > 0)
+  {
+    replicaterun();
+    return EXIT_SUCCESS;
+  }
+  if (delaybound > 0)
+  {
+    optimize();
+    return EXIT_SUCCESS;
+  }
+  if (buffercompare)
+  {
+    bufferingrun();
+    return EXIT_SUCCESS;
+  }
+  if (nphases > 0)
+  {
+    scenariorun();
+    return EXIT_SUCCESS;
+  }
+  if (burst > 0)
+  {
+    tailrun();
+    return EXIT_SUCCESS;
+  }
+  if (incast)
+  {
+    incastrun();
+    return EXIT_SUCCESS;
+  }
+  if (ecncompare)
+  {
+    ecnrun();
+    return EXIT_SUCCESS;
+  }
+  if (loadfile != NULL)
+    loadsnapshot();
+  else
+    setup();
+  run();
+  if (snaptime != NEVER)
+    printf("no snapshot written, the run ended before time %f\n", snapat);
+  report();
   return EXIT_SUCCESS;
 }
@@ -1,15 +1,33 @@
 extern int TRACE;
 
-/* statistics updated by GBN */
-extern int total_ACKs_received;
-extern int packets_resent;   /* count of the number of packets resent  */
-extern int new_ACKs;         /* count of the number of acks correctly received */
-extern int packets_received; /* count of the packets received by receiver */
-extern int window_full;      /* count of the number of messages dropped due to full window */
+/* How wide the emulator's counts of messages, packets and events are: int
+   as they always have been, which overflows past 2^31, or 64 bits when
+   built with -DCOUNT64 for runs of billions of messages.  COUNT is the
+   printf and scanf conversion for a counter. */
+#ifdef COUNT64
+typedef long long counter;
+#define COUNT "lld"
+#else
+typedef int counter;
+#define COUNT "d"
+#endif
+
+/* statistics updated by the protocols, kept separately for every connection */
+struct stats
+{
+  counter total_ACKs_received;
+  counter packets_resent;   /* count of the number of packets resent  */
+  counter new_ACKs;         /* count of the number of acks correctly received */
+  counter packets_received; /* count of the packets received by receiver */
+  counter window_full;      /* count of the number of messages dropped due to full window */
+};
 
 #define A 0
 #define B 1
 
+/* included for extension to bidirectional communication */
+#define BIDIRECTIONAL 0 /*  0 = A->B  1 =  A<->B */
+
 /* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
 /* 4 (students' code).  It contains the data (characters) to be delivered */
 /* to layer 5 via the students transport level protocol entities.         */
@@ -27,11 +45,22 @@ struct pkt
   int acknum;
   int checksum;
   char payload[20];
+  int flags; /* ECN bits below, not covered by the checksum */
 };
 
+/* ECN: senders set ECT on packets when ecn is set, routers set CE instead
+   of dropping such packets, and receivers echo CE as ECE in their ACKs */
+#define ECT 1 /* ECN capable transport */
+#define CE 2  /* congestion experienced */
+#define ECE 4 /* congestion experienced echo */
+
 /* send to A or B (int), packet to send */
 extern void tolayer3(int, struct pkt);
 
+/* send from A or B (int) the packets (array) in order, number of packets.
+   The same as that many calls of tolayer3, with the work they share done once. */
+extern void tolayer3_burst(int, struct pkt[], int);
+
 /* deliver to A or B (int), data to deliver */
 extern void tolayer5(int, char[20]);
 
@@ -40,3 +69,93 @@ extern void starttimer(int, double);
 
 /* stop timer at A or B (int) */
 extern void stoptimer(int);
+
+/* the current simulated time */
+extern double gettime(void);
+
+/* How the emulator's clock keeps simulated time: in single precision as
+   it always has, which loses resolution past a few million time units, in
+   double precision, or in 64-bit integer ticks of 1/TICKS time unit.
+   Build with -DSIMCLOCK=DOUBLECLOCK or -DSIMCLOCK=TICKCLOCK to change it. */
+#define FLOATCLOCK 0
+#define DOUBLECLOCK 1
+#define TICKCLOCK 2
+#ifndef SIMCLOCK
+#define SIMCLOCK FLOATCLOCK
+#endif
+
+#if SIMCLOCK == TICKCLOCK
+#define TICKS 1048576 /* ticks per time unit */
+typedef long long clocktime;
+#define CLOCK(u) ((clocktime)((u) * TICKS + 0.5)) /* a duration in time units as the clock keeps it */
+#define UNITS(t) ((double)(t) / TICKS)             /* and back */
+#elif SIMCLOCK == DOUBLECLOCK
+typedef double clocktime;
+#define CLOCK(u) (u)
+#define UNITS(t) (t)
+#else
+typedef float clocktime;
+#define CLOCK(u) (u)
+#define UNITS(t) (t)
+#endif
+
+/* set when senders should adapt their retransmission timeout, see rto.h */
+extern int adaptive_rto;
+
+/* set when senders should find losses by time and probe for tail losses,
+   see rack.h */
+extern int rack;
+
+/* set when go-back-N receivers should hold packets that arrive out of
+   order within the window, see gbn.c */
+extern int gbn_buffering;
+
+/* set when senders should keep a congestion window, see cc.h, and when
+   they should also mark their packets ECN capable */
+extern int congestion_control;
+extern int ecn;
+
+/* the tuning senders start with, as the optimizer sets it: the most packets
+   awaiting an ACK, up to the protocol's window, and the retransmission
+   timeout; 0 leaves the protocol's own window and RTT */
+extern int window_limit;
+extern double rto_initial;
+
+/* The emulator runs many connections at once, each with its own protocol
+   instance.  Before calling any A_ or B_ routine it points these at the
+   connection being serviced, and A and B in the routines above refer to
+   the two ends of that connection.  In sharded runs every thread services
+   connections of its own, so these are kept per thread. */
+extern _Thread_local void *Astate;            /* sender state, Asize bytes, zeroed before A_init */
+extern _Thread_local void *Bstate;            /* receiver state, Bsize bytes, zeroed before B_init */
+extern _Thread_local struct stats *connstats; /* statistics of the connection */
+
+/* what a protocol resends on a loss, for the throughput model */
+#define STOPWAIT 0  /* the one packet outstanding */
+#define GOBACKN 1   /* it and every packet sent after it */
+#define SELECTIVE 2 /* only the packet lost */
+#define SWITCHING 3 /* either of the two, as the losses it sees decide */
+
+/* a transport protocol: its entity routines and the size of its state */
+struct protocol
+{
+  const char *name;
+  int Asize;
+  int Bsize;
+  int window; /* the most packets its buffers let await an ACK */
+  double rtt; /* the retransmission timeout it starts with */
+  int resend; /* STOPWAIT, GOBACKN, SELECTIVE or SWITCHING */
+  int adapts; /* set when its timeout and window adapt whatever -r and -C say */
+  void (*A_init)(void);
+  void (*B_init)(void);
+  void (*A_input)(struct pkt);
+  void (*B_input)(struct pkt);
+  void (*A_output)(struct msg);
+  void (*B_output)(struct msg);
+  void (*A_timerinterrupt)(void);
+  void (*B_timerinterrupt)(void);
+  /* packets that arrived for A or B at the same instant, in the order they
+     came, in one call; NULL to have them given one at a time */
+  void (*A_input_batch)(struct pkt *packets, int n);
+  void (*B_input_batch)(struct pkt *packets, int n);
+};
@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "emulator.h"
+#include "event.h"
+
+int evqueue = EVHEAP;
+int evstamp = 0;
+
+/********************* SORTED LIST *******************/
+
+static _Thread_local struct event *evlist = NULL; /* the event list */
+
+static void listinsert(struct event *p)
+{
+  struct event *q, *qold;
+
+  q = evlist; /* q points to front of list in which p struct inserted */
+  if (q == NULL)
+  { /* list is empty */
+    evlist = p;
+    p->next = NULL;
+    p->prev = NULL;
+  }
+  else
+  {
+    for (qold = q; q != NULL && p->evtime > q->evtime; q = q->next)
+      qold = q;
+    if (q == NULL)
+    { /* end of list */
+      qold->next = p;
+      p->prev = qold;
+      p->next = NULL;
+    }
+    else if (q == evlist)
+    { /* front of list */
+      p->next = evlist;
+      p->prev = NULL;
+      p->next->prev = p;
+      evlist = p;
+    }
+    else
+    { /* middle of list */
+      p->next = q;
+      p->prev = q->prev;
+      q->prev->next = p;
+      q->prev = p;
+    }
+  }
+}
+
+static void listremove(struct event *q)
+{
+  if (q->next == NULL && q->prev == NULL)
+    evlist = NULL;          /* remove first and only event on list */
+  else if (q->next == NULL) /* end of list - there is one in front */
+    q->prev->next = NULL;
+  else if (q == evlist)
+  { /* front of list - there must be event after */
+    q->next->prev = NULL;
+    evlist = q->next;
+  }
+  else
+  { /* middle of list */
+    q->next->prev = q->prev;
+    q->prev->next = q->next;
+  }
+}
+
+static struct event *listpop(void)
+{
+  struct event *p = evlist;
+
+  if (p == NULL)
+    return NULL;
+  evlist = evlist->next; /* remove this event from event list */
+  if (evlist != NULL)
+    evlist->prev = NULL;
+  return p;
+}
+
+/********************* BINARY HEAP *******************/
+
+static _Thread_local struct event **heap;     /* heap[0] is the next event */
+static _Thread_local unsigned long nheap;     /* events in the heap */
+static _Thread_local unsigned long heapmax;   /* room in heap[] */
+static _Thread_local unsigned long long nseq; /* events inserted so far */
+
+/* does p come out of the queue before q? */
+static int before(struct event *p, struct event *q)
+{
+  return p->evtime < q->evtime || (p->evtime == q->evtime && p->evseq > q->evseq);
+}
+
+static void place(struct event *p, unsigned int i)
+{
+  heap[i] = p;
+  p->evindex = i;
+}
+
+static void siftup(struct event *p, unsigned long i)
+{
+  while (i > 0 && before(p, heap[(i - 1) / 2]))
+  {
+    place(heap[(i - 1) / 2], i);
+    i = (i - 1) / 2;
+  }
+  place(p, i);
+}
+
+static void siftdown(struct event *p, unsigned long i)
+{
+  unsigned long child;
+
+  while ((child = 2 * i + 1) < nheap)
+  {
+    if (child + 1 < nheap && before(heap[child + 1], heap[child]))
+      child++;
+    if (!before(heap[child], p))
+      break;
+    place(heap[child], i);
+    i = child;
+  }
+  place(p, i);
+}
+
+static void heapinsert(struct event *p)
+{
+  if (nheap == heapmax)
+  {
+    heapmax = heapmax ? 2 * heapmax : 1024;
+    heap = realloc(heap, heapmax * sizeof(struct event *));
+    if (heap == NULL)
+    {
+      printf("memory allocation for event heap failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (!evstamp)
+    p->evseq = nseq++;
+  nheap++;
+  siftup(p, nheap - 1);
+}
+
+static void heapremove(struct event *p)
+{
+  unsigned long i = p->evindex;
+  struct event *last = heap[--nheap];
+
+  if (last == p)
+    return;
+  if (i > 0 && before(last, heap[(i - 1) / 2]))
+    siftup(last, i);
+  else
+    siftdown(last, i);
+}
+
+static struct event *heappop(void)
+{
+  struct event *p;
+
+  if (nheap == 0)
+    return NULL;
+  p = heap[0];
+  heapremove(p);
+  return p;
+}
+
+/********************* FIFOS *************************/
+
+/* Only the first event of a FIFO is in the heap, and when it is taken the
+   next one takes its place.  As events are appended in the order they come
+   out, the heap hands out the events in the same order as it would with
+   all of them in it, while appending is O(1) and the heap stays small. */
+
+struct fifo
+{
+  struct event **ring; /* events from ring[head], wrapping around */
+  unsigned long head, n, max;
+};
+
+static _Thread_local struct fifo *fifos; /* fifos[0] is not used */
+static _Thread_local unsigned int nfifos, fifomax;
+
+unsigned int evnewfifo(void)
+{
+  struct fifo *f;
+
+  if (nfifos == 0)
+    nfifos = 1;
+  if (nfifos >= fifomax)
+  {
+    fifomax = fifomax ? 2 * fifomax : 1024;
+    fifos = realloc(fifos, fifomax * sizeof(struct fifo));
+    if (fifos == NULL)
+    {
+      printf("memory allocation for event fifos failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (f = &fifos[nfifos]; f < &fifos[fifomax]; f++)
+    {
+      f->ring = NULL;
+      f->max = 0;
+    }
+  }
+  f = &fifos[nfifos];
+  f->head = f->n = 0;
+  return nfifos++;
+}
+
+static void fifopush(struct fifo *f, struct event *p)
+{
+  struct event **ring;
+  unsigned long i;
+
+  if (f->n == f->max)
+  { /* grow, unwrapping the events */
+    ring = malloc((f->max ? 2 * f->max : 8) * sizeof(struct event *));
+    if (ring == NULL)
+    {
+      printf("memory allocation for event fifos failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < f->n; i++)
+      ring[i] = f->ring[(f->head + i) & (f->max - 1)];
+    free(f->ring);
+    f->ring = ring;
+    f->head = 0;
+    f->max = f->max ? 2 * f->max : 8;
+  }
+  f->ring[(f->head + f->n++) & (f->max - 1)] = p;
+}
+
+static void fifoappend(struct event *p, unsigned int fifo)
+{
+  struct fifo *f = &fifos[fifo];
+
+  if (f->n > 0 && f->ring[(f->head + f->n - 1) & (f->max - 1)]->evtime >= p->evtime)
+  { /* it ties with the last one, and so comes out before it: on its own */
+    p->evfifo = 0;
+    heapinsert(p);
+    return;
+  }
+  p->evfifo = fifo;
+  fifopush(f, p);
+  if (f->n == 1)
+    heapinsert(p);
+  else
+    p->evseq = nseq++;
+}
+
+static struct event *fifopop(void)
+{
+  struct event *p;
+  struct fifo *f;
+
+  if (nheap == 0)
+    return NULL;
+  p = heap[0];
+  if (p->evfifo == 0)
+  {
+    heapremove(p);
+    return p;
+  }
+  f = &fifos[p->evfifo];
+  f->head = (f->head + 1) & (f->max - 1);
+  if (--f->n == 0)
+    heapremove(p);
+  else /* the next of the FIFO takes its place */
+    siftdown(f->ring[f->head], 0);
+  return p;
+}
+
+/********************* QUEUE INTERFACE ***************/
+
+void evinsert(struct event *p)
+{
+  if (evqueue == EVLIST)
+    listinsert(p);
+  else
+  {
+    p->evfifo = 0;
+    heapinsert(p);
+  }
+}
+
+void evappend(struct event *p, unsigned int fifo)
+{
+  if (evqueue == EVFIFO)
+    fifoappend(p, fifo);
+  else
+    evinsert(p);
+}
+
+void evremove(struct event *p)
+{
+  if (evqueue == EVLIST)
+    listremove(p);
+  else
+    heapremove(p);
+}
+
+struct event *evpop(void)
+{
+  if (evqueue == EVHEAP)
+    return heappop();
+  if (evqueue == EVFIFO)
+    return fifopop();
+  return listpop();
+}
+
+struct event *evpeek(void)
+{
+  if (evqueue == EVLIST)
+    return evlist;
+  return nheap > 0 ? heap[0] : NULL;
+}
+
+void evreset(void)
+{
+  evlist = NULL;
+  nheap = 0;
+  nseq = 0;
+  nfifos = 0;
+}
+
+void evrelease(void)
+{
+  unsigned int i;
+
+  evreset();
+  free(heap);
+  heap = NULL;
+  heapmax = 0;
+  for (i = 0; i < fifomax; i++)
+    free(fifos[i].ring);
+  free(fifos);
+  fifos = NULL;
+  fifomax = 0;
+}
+
+size_t evsize(void)
+{
+  size_t size = heapmax * sizeof(struct event *) + fifomax * sizeof(struct fifo);
+  unsigned int i;
+
+  for (i = 0; i < fifomax; i++)
+    size += fifos[i].max * sizeof(struct event *);
+  return size;
+}
+
+void printevlist(void)
+{
+  struct event *q;
+  unsigned long i;
+  unsigned int j;
+
+  printf("--------------\nEvent List Follows:\n");
+  for (q = evlist; q != NULL; q = q->next)
+    printf("Event time: %f, type: %d entity: %d\n", UNITS(q->evtime), q->evtype, q->eventity);
+  for (i = 0; i < nheap; i++) /* in heap order, not time order */
+    printf("Event time: %f, type: %d entity: %d\n", UNITS(heap[i]->evtime), heap[i]->evtype, heap[i]->eventity);
+  for (j = 1; j < nfifos; j++) /* and the FIFOs behind their first events */
+    for (i = 1; i < fifos[j].n; i++)
+    {
+      q = fifos[j].ring[(fifos[j].head + i) & (fifos[j].max - 1)];
+      printf("Event time: %f, type: %d entity: %d\n", UNITS(q->evtime), q->evtype, q->eventity);
+    }
+  printf("--------------\n");
+}
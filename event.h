@@ -0,0 +1,56 @@
+/* Pending events of the emulator.  They are kept either in the original
+   sorted list or, for runs with many connections, in a binary heap, or in
+   FIFOs of events that come in time order, such as the arrivals from one
+   channel, with a heap over the FIFOs' first events and the other events.
+   All hand out events in the same order: by time, and among events at the
+   same time the one inserted last comes first, or with evstamp set the
+   one with the larger evseq given by the caller.  Every thread has a
+   queue of its own. */
+
+struct pkt;
+
+struct event
+{
+  clocktime evtime;          /* event time, see emulator.h */
+  int evtype;                /* event type code */
+  int eventity;              /* entity where event occurs */
+  int evhop;                 /* routers passed so far on the way there */
+  unsigned long long evconn; /* key of the connection the entity belongs to */
+  struct pkt *pktptr;        /* ptr to packet (if any) assoc w/ this event */
+  union
+  {
+    struct
+    {
+      struct event *prev; /* neighbours in the list */
+      struct event *next;
+    };
+    struct
+    {
+      unsigned long long evseq; /* insertion order, breaks ties in the heap */
+      unsigned int evindex;     /* position in the heap */
+      unsigned int evfifo;      /* FIFO it was appended to, 0 for none */
+    };
+  };
+};
+
+/* event queues */
+#define EVLIST 0
+#define EVHEAP 1
+#define EVFIFO 2
+
+extern int evqueue; /* the queue in use */
+extern int evstamp; /* set when callers stamp events with their own evseq, heap only */
+
+extern void evinsert(struct event *p);
+extern void evremove(struct event *p); /* not for events appended to a FIFO */
+
+/* a FIFO of the thread's queue, and insert p, whose time is not before that
+   of any event appended to the FIFO so far, by way of it */
+extern unsigned int evnewfifo(void);
+extern void evappend(struct event *p, unsigned int fifo);
+extern struct event *evpop(void); /* remove and return the next event, NULL if none */
+extern struct event *evpeek(void);  /* the next event, left in the queue, NULL if none */
+extern void evreset(void);        /* forget all events, ready for a fresh run */
+extern void evrelease(void);      /* and give back the queue's memory */
+extern size_t evsize(void);       /* bytes used by the queue itself */
+extern void printevlist(void);
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "emulator.h"
+#include "slab.h"
+#include "rto.h"
+#include "cc.h"
 #include "gbn.h"
 
 /* ******************************************************************
@@ -20,11 +23,13 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - with gbn_buffering B holds packets that arrive out of order within
+   the window, and delivers and ACKs them in one once the gap is filled.
 **********************************************************************/
 
 #define RTT 16.0      /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
 #define WINDOWSIZE 6  /* the maximum number of buffered unacked packet */
-#define SEQSPACE 7    /* the min sequence space for GBN must be at least windowsize + 1 */
+#define SEQSPACE 12   /* at least 2 * windowsize, as B may hold packets out of order */
 #define NOTINUSE (-1) /* used to fill header fields that are not being used */
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
@@ -32,7 +37,7 @@
    original checksum.  This procedure must generate a different checksum to the original if
    the packet is corrupted.
 */
-int ComputeChecksum(struct pkt packet)
+static int ComputeChecksum(struct pkt packet)
 {
   int checksum = 0;
   int i;
@@ -45,7 +50,7 @@ int ComputeChecksum(struct pkt packet)
   return checksum;
 }
 
-bool IsCorrupted(struct pkt packet)
+static bool IsCorrupted(struct pkt packet)
 {
   if (packet.checksum == ComputeChecksum(packet))
     return (false);
@@ -55,62 +60,78 @@ bool IsCorrupted(struct pkt packet)
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE]; /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;   /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;               /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;              /* the next sequence number to be used by the sender */
+/* sender state of one connection, found through Astate */
+struct sender
+{
+  slabref buffer;                      /* array for storing packets waiting for ACK, while there are any */
+  signed char windowfirst, windowlast; /* array indexes of the first/last packet awaiting ACK */
+  unsigned char windowcount;           /* the number of packets currently awaiting an ACK */
+  unsigned char A_nextseqnum;          /* the next sequence number to be used by the sender */
+  struct rto rto;                      /* retransmission timeout */
+  struct cwnd cw;                      /* congestion window */
+};
+
+#define BUFFERSIZE (WINDOWSIZE * sizeof(struct pkt))
+#define BIT(n) (1u << (n)) /* packets B holds are kept in a bitmap by their distance from the one expected */
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+static void A_output(struct msg message)
 {
+  struct sender *s = Astate;
+  struct pkt *buffer;
   struct pkt sendpkt;
   int i;
 
   /* if not blocked waiting on ACK */
-  if (windowcount < WINDOWSIZE)
+  if (s->windowcount < ccwindow(&s->cw))
   {
     if (TRACE > 1)
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
 
     /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
+    sendpkt.seqnum = s->A_nextseqnum;
     sendpkt.acknum = NOTINUSE;
     for (i = 0; i < 20; i++)
       sendpkt.payload[i] = message.data[i];
+    sendpkt.flags = ecn ? ECT : 0;
     sendpkt.checksum = ComputeChecksum(sendpkt);
 
-    /* put packet in window buffer */
+    /* put packet in window buffer, taken from the pool for the first one */
     /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE;
-    buffer[windowlast] = sendpkt;
-    windowcount++;
+    if (s->windowcount == 0)
+      s->buffer = slabget(BUFFERSIZE);
+    buffer = slabptr(s->buffer);
+    s->windowlast = (s->windowlast + 1) % WINDOWSIZE;
+    buffer[s->windowlast] = sendpkt;
+    s->windowcount++;
 
     /* send out packet */
     if (TRACE > 0)
       printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
     tolayer3(A, sendpkt);
+    rtosent(&s->rto, sendpkt.seqnum);
 
     /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A, RTT);
+    if (s->windowcount == 1)
+      starttimer(A, rtotimeout(&s->rto));
 
     /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    s->A_nextseqnum = (s->A_nextseqnum + 1) % SEQSPACE;
   }
   /* if blocked,  window is full */
   else
   {
     if (TRACE > 0)
       printf("----A: New message arrives, send window is full\n");
-    window_full++;
+    connstats->window_full++;
   }
 }
 
-/* called from layer 3, when a packet arrives for layer 4
-   In this practical this will always be an ACK as B never sends data.
-*/
-void A_input(struct pkt packet)
+/* take in an ACK, sliding the window past the packets it acknowledges.
+   Returns whether it was a new ACK, after which the timer is re-armed. */
+static bool A_ack(struct sender *s, struct pkt packet)
 {
+  struct pkt *buffer = slabptr(s->buffer);
   int ackcount = 0;
   int i;
 
@@ -119,13 +140,15 @@ void A_input(struct pkt packet)
   {
     if (TRACE > 0)
       printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
-    total_ACKs_received++;
+    connstats->total_ACKs_received++;
+    if (packet.flags & ECE)
+      ccmarked(&s->cw);
 
     /* check if new ACK or duplicate */
-    if (windowcount != 0)
+    if (s->windowcount != 0)
     {
-      int seqfirst = buffer[windowfirst].seqnum;
-      int seqlast = buffer[windowlast].seqnum;
+      int seqfirst = buffer[s->windowfirst].seqnum;
+      int seqlast = buffer[s->windowlast].seqnum;
       /* check case when seqnum has and hasn't wrapped */
       if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
           ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast)))
@@ -134,25 +157,27 @@ void A_input(struct pkt packet)
         /* packet is a new ACK */
         if (TRACE > 0)
           printf("----A: ACK %d is not a duplicate\n", packet.acknum);
-        new_ACKs++;
+        connstats->new_ACKs++;
 
         /* cumulative acknowledgement - determine how many packets are ACKed */
         if (packet.acknum >= seqfirst)
           ackcount = packet.acknum + 1 - seqfirst;
         else
-          ackcount = SEQSPACE - seqfirst + packet.acknum;
+          ackcount = SEQSPACE - seqfirst + packet.acknum + 1;
+
+        /* take a round trip sample if the packet being timed is among them */
+        if (s->rto.seq != -1 && (s->rto.seq - seqfirst + SEQSPACE) % SEQSPACE < ackcount)
+          rtoacked(&s->rto);
+
+        ccacked(&s->cw, ackcount);
 
         /* slide window by the number of packets ACKed */
-        windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
+        s->windowfirst = (s->windowfirst + ackcount) % WINDOWSIZE;
 
         /* delete the acked packets from window buffer */
         for (i = 0; i < ackcount; i++)
-          windowcount--;
-
-        /* start timer again if there are still more unacked packets in window */
-        stoptimer(A);
-        if (windowcount > 0)
-          starttimer(A, RTT);
+          s->windowcount--;
+        return true;
       }
     }
     else if (TRACE > 0)
@@ -160,84 +185,178 @@ void A_input(struct pkt packet)
   }
   else if (TRACE > 0)
     printf("----A: corrupted ACK is received, do nothing!\n");
+  return false;
+}
+
+/* after new ACKs: start timer again if there are still more unacked packets in window */
+static void A_rearm(struct sender *s)
+{
+  stoptimer(A);
+  if (s->windowcount > 0)
+    starttimer(A, rtotimeout(&s->rto));
+  else
+  {
+    /* nothing left to resend, give the buffer back to the pool */
+    slabput(s->buffer, BUFFERSIZE);
+    s->buffer = 0;
+  }
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   In this practical this will always be an ACK as B never sends data.
+*/
+static void A_input(struct pkt packet)
+{
+  struct sender *s = Astate;
+
+  if (A_ack(s, packet))
+    A_rearm(s);
+}
+
+/* called from layer 3 with the ACKs that arrived at the same instant: the
+   window slides past all of them and the timer is re-armed once */
+static void A_input_batch(struct pkt *packets, int n)
+{
+  struct sender *s = Astate;
+  bool acked = false;
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (A_ack(s, packets[i]))
+      acked = true;
+  if (acked)
+    A_rearm(s);
 }
 
 /* called when A's timer goes off */
-void A_timerinterrupt(void)
+static void A_timerinterrupt(void)
 {
+  struct sender *s = Astate;
+  struct pkt *buffer = slabptr(s->buffer);
+  struct pkt burst[WINDOWSIZE];
   int i;
 
   if (TRACE > 0)
     printf("----A: time out,resend packets!\n");
+  rtoexpired(&s->rto);
+  cctimeout(&s->cw);
 
-  for (i = 0; i < windowcount; i++)
+  /* resend the whole window in one burst, oldest first */
+  for (i = 0; i < s->windowcount; i++)
   {
 
     if (TRACE > 0)
-      printf("---A: resending packet %d\n", (buffer[(windowfirst + i) % WINDOWSIZE]).seqnum);
+      printf("---A: resending packet %d\n", (buffer[(s->windowfirst + i) % WINDOWSIZE]).seqnum);
 
-    tolayer3(A, buffer[(windowfirst + i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i == 0)
-      starttimer(A, RTT);
+    burst[i] = buffer[(s->windowfirst + i) % WINDOWSIZE];
   }
+  tolayer3_burst(A, burst, s->windowcount);
+  connstats->packets_resent += s->windowcount;
+  if (s->windowcount > 0)
+    starttimer(A, rtotimeout(&s->rto));
 }
 
 /* the following routine will be called once (only) before any other */
 /* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+static void A_init(void)
 {
+  struct sender *s = Astate;
+
   /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0; /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1; /* windowlast is where the last packet sent is stored.
+  s->A_nextseqnum = 0; /* A starts with seq num 0, do not change this */
+  s->windowfirst = 0;
+  s->windowlast = -1; /* windowlast is where the last packet sent is stored.
        new packets are placed in winlast + 1
        so initially this is set to -1
      */
-  windowcount = 0;
+  s->windowcount = 0;
+  s->buffer = 0; /* no buffer until there is something to send */
+  rtoinit(&s->rto, rto_initial > 0 ? rto_initial : RTT, adaptive_rto);
+  ccinit(&s->cw, window_limit > 0 && window_limit < WINDOWSIZE ? window_limit : WINDOWSIZE, congestion_control);
 }
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+/* receiver state of one connection, found through Bstate */
+struct receiver
+{
+  slabref buffer;               /* packets out of order by sequence number % WINDOWSIZE, while there are any */
+  unsigned char expectedseqnum; /* the sequence number expected next by the receiver */
+  unsigned char B_nextseqnum;   /* the sequence number for the next packets sent by B */
+  unsigned char held;           /* packets held with gbn_buffering, by distance from expectedseqnum */
+};
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+static void B_input(struct pkt packet)
 {
+  struct receiver *r = Bstate;
+  struct pkt *buffer;
   struct pkt sendpkt;
-  int i;
+  int i, d;
+
+  d = (packet.seqnum - r->expectedseqnum + SEQSPACE) % SEQSPACE;
 
   /* if not corrupted and received packet is in order */
-  if ((!IsCorrupted(packet)) && (packet.seqnum == expectedseqnum))
+  if ((!IsCorrupted(packet)) && (packet.seqnum == r->expectedseqnum))
   {
     if (TRACE > 0)
       printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
-    packets_received++;
+    connstats->packets_received++;
 
     /* deliver to receiving application */
     tolayer5(B, packet.payload);
 
     /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
+    sendpkt.acknum = r->expectedseqnum;
 
     /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+    r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+
+    /* deliver the packets held after it, and ACK them all in one */
+    r->held >>= 1;
+    while (r->held & BIT(0))
+    {
+      buffer = slabptr(r->buffer);
+      tolayer5(B, buffer[r->expectedseqnum % WINDOWSIZE].payload);
+      sendpkt.acknum = r->expectedseqnum;
+      r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+      r->held >>= 1;
+    }
+    if (r->held == 0 && r->buffer != 0)
+    {
+      slabput(r->buffer, BUFFERSIZE);
+      r->buffer = 0;
+    }
+  }
+  else if (gbn_buffering && !IsCorrupted(packet) && d < WINDOWSIZE && !(r->held & BIT(d)))
+  {
+    /* out of order but in the window: hold it until the gap is filled,
+       and resend the last ACK meanwhile */
+    if (TRACE > 0)
+      printf("----B: packet %d is out of order, hold it and resend ACK!\n", packet.seqnum);
+    connstats->packets_received++;
+    if (r->held == 0)
+      r->buffer = slabget(BUFFERSIZE);
+    buffer = slabptr(r->buffer);
+    buffer[packet.seqnum % WINDOWSIZE] = packet;
+    r->held |= BIT(d);
+    sendpkt.acknum = (r->expectedseqnum + SEQSPACE - 1) % SEQSPACE;
   }
   else
   {
     /* packet is corrupted or out of order resend last ACK */
     if (TRACE > 0)
       printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
+    if (r->expectedseqnum == 0)
       sendpkt.acknum = SEQSPACE - 1;
     else
-      sendpkt.acknum = expectedseqnum - 1;
+      sendpkt.acknum = r->expectedseqnum - 1;
   }
 
-  /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
+  /* create packet, echoing a congestion mark */
+  sendpkt.seqnum = r->B_nextseqnum;
+  sendpkt.flags = (packet.flags & CE) ? ECE : 0;
+  r->B_nextseqnum = (r->B_nextseqnum + 1) % 2;
 
   /* we don't have any data to send.  fill payload with 0's */
   for (i = 0; i < 20; i++)
@@ -252,10 +371,14 @@ void B_input(struct pkt packet)
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+static void B_init(void)
 {
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
+  struct receiver *r = Bstate;
+
+  r->expectedseqnum = 0;
+  r->B_nextseqnum = 1;
+  r->held = 0;
+  r->buffer = 0;
 }
 
 /******************************************************************************
@@ -263,11 +386,15 @@ void B_init(void)
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+static void B_output(struct msg message)
 {
 }
 
 /* called when B's timer goes off */
-void B_timerinterrupt(void)
+static void B_timerinterrupt(void)
 {
 }
+
+const struct protocol gbn_protocol = {
+    "gbn", sizeof(struct sender), sizeof(struct receiver), WINDOWSIZE, RTT, GOBACKN, 0,
+    A_init, B_init, A_input, B_input, A_output, B_output, A_timerinterrupt, B_timerinterrupt, A_input_batch, NULL};
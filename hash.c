@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "slab.h"
+#include "hash.h"
+
+/* spread the key bits over the whole word (splitmix64 finaliser) */
+static unsigned long long mix(unsigned long long key)
+{
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return key;
+}
+
+void hashinit(struct hashtable *t, unsigned long n)
+{
+  unsigned long size = 2;
+  unsigned long i;
+
+  while (size < 2 * n)
+    size *= 2;
+  t->slots = slaballoc(size * sizeof(struct hashslot));
+  for (i = 0; i < size; i++)
+    t->slots[i].val = NULL;
+  t->mask = size - 1;
+}
+
+void *hashfind(struct hashtable *t, unsigned long long key)
+{
+  unsigned long i;
+
+  for (i = mix(key) & t->mask; t->slots[i].val != NULL; i = (i + 1) & t->mask)
+    if (t->slots[i].key == key)
+      return t->slots[i].val;
+  return NULL;
+}
+
+void hashinsert(struct hashtable *t, unsigned long long key, void *val)
+{
+  unsigned long i;
+
+  for (i = mix(key) & t->mask; t->slots[i].val != NULL; i = (i + 1) & t->mask)
+    if (t->slots[i].key == key)
+      break;
+  t->slots[i].key = key;
+  t->slots[i].val = val;
+}
+
+void hashmove(struct hashtable *t, ptrdiff_t delta)
+{
+  unsigned long i;
+
+  t->slots = (struct hashslot *)((char *)t->slots + delta);
+  for (i = 0; i <= t->mask; i++)
+    if (t->slots[i].val != NULL)
+      t->slots[i].val = (char *)t->slots[i].val + delta;
+}
@@ -0,0 +1,26 @@
+/* Open-addressing hash table from 64-bit keys to pointers.  The size is
+   fixed when the table is made; it holds up to half as many entries as
+   slots and probes linearly, so a lookup is usually one cache line. */
+
+#include <stddef.h>
+
+struct hashslot
+{
+  unsigned long long key;
+  void *val; /* NULL in an empty slot */
+};
+
+struct hashtable
+{
+  struct hashslot *slots;
+  unsigned long mask; /* number of slots - 1 */
+};
+
+/* make t ready to hold n entries */
+extern void hashinit(struct hashtable *t, unsigned long n);
+extern void *hashfind(struct hashtable *t, unsigned long long key);
+extern void hashinsert(struct hashtable *t, unsigned long long key, void *val);
+
+/* the table and every value in it have moved by delta bytes, as when the
+   slab pool they are in is restored from a snapshot */
+extern void hashmove(struct hashtable *t, ptrdiff_t delta);
@@ -0,0 +1,409 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "slab.h"
+#include "rto.h"
+#include "cc.h"
+#include "hybrid.h"
+
+/* ******************************************************************
+   Go-back-N / selective repeat hybrid, on the emulator of J.F.Kurose
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2
+
+   Network properties:
+   - one way network delay averages five time units (longer if there
+   are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+   or lost, according to user-defined probabilities
+   - packets will be delivered in the order in which they were sent
+   (although some can be lost).
+
+   Protocol:
+   - the sender keeps an estimate of the part of its packets that time
+   out, and recovers as go-back-N while it is below TOSR and as
+   selective repeat once it is above, until it falls below TOGBN.
+   - the mode is a bit in the flags of every data packet, resent ones
+   too, and B follows it packet by packet: with it clear B takes only
+   the packet it expects and ACKs cumulatively, with it set B holds
+   packets out of order and ACKs each one.  ACKs echo the bit, so A
+   reads each ACK the way B meant it whatever mode A is in by then.
+   - on a timeout A resends every packet awaiting an ACK in go-back-N
+   mode and the oldest one in selective repeat mode.
+**********************************************************************/
+
+#define RTT 16.0      /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#define WINDOWSIZE 6  /* the maximum number of buffered unacked packet */
+#define SEQSPACE 12   /* at least 2 * windowsize, as B may hold packets out of order */
+#define NOTINUSE (-1) /* used to fill header fields that are not being used */
+#define SRMODE 8      /* in the flags beside the ECN bits: selective repeat */
+#define LOSSGAIN 32   /* packets the timeout estimate averages over */
+#define TOSR 0.04     /* timeouts per packet above which A goes selective repeat, */
+#define TOGBN 0.01    /* and below which it goes back to go-back-N */
+
+#define BUFFERSIZE (WINDOWSIZE * sizeof(struct pkt))
+#define BIT(n) (1u << (n)) /* packets are kept in bitmaps by their distance from the first awaiting an ACK */
+#define BELOW(n) (BIT(n) - 1)
+
+_Thread_local counter modeswitches;
+
+/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
+   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
+   original checksum.  This procedure must generate a different checksum to the original if
+   the packet is corrupted.
+*/
+static int ComputeChecksum(struct pkt packet)
+{
+  int checksum = 0;
+  int i;
+
+  checksum = packet.seqnum;
+  checksum += packet.acknum;
+  for (i = 0; i < 20; i++)
+    checksum += (int)(packet.payload[i]);
+
+  return checksum;
+}
+
+static bool IsCorrupted(struct pkt packet)
+{
+  if (packet.checksum == ComputeChecksum(packet))
+    return (false);
+  else
+    return (true);
+}
+
+static int count(unsigned int bits)
+{
+  int n = 0;
+
+  for (; bits != 0; bits &= bits - 1)
+    n++;
+  return n;
+}
+
+/********* Sender (A) variables and functions ************/
+
+/* sender state of one connection, found through Astate */
+struct sender
+{
+  slabref buffer;            /* packets awaiting an ACK by sequence number % WINDOWSIZE, while there are any */
+  unsigned char base;        /* sequence number of the first packet awaiting an ACK */
+  unsigned char nextseq;     /* sequence number of the next new packet */
+  unsigned char windowcount; /* the number of packets currently awaiting an ACK */
+  unsigned char mode;        /* 0 for go-back-N, SRMODE for selective repeat */
+  unsigned short acked;      /* packets ACKed beyond base, by distance from it */
+  float timeouts;            /* timeouts per packet ACKed, averaged */
+  struct rto rto;            /* retransmission timeout */
+  struct cwnd cw;            /* congestion window */
+};
+
+/* go over to the mode the timeout estimate calls for, marking the
+   packets awaiting an ACK with it for when they are resent */
+static void A_adapt(struct sender *s)
+{
+  struct pkt *p;
+  int mode = s->mode, i;
+
+  if (s->mode == 0 && s->timeouts > TOSR)
+    mode = SRMODE;
+  else if (s->mode == SRMODE && s->timeouts < TOGBN)
+    mode = 0;
+  if (mode == s->mode)
+    return;
+  if (TRACE > 0)
+    printf("----A: %.3f timeouts per packet, going over to %s\n", s->timeouts,
+           mode ? "selective repeat" : "go-back-N");
+  s->mode = mode;
+  modeswitches++;
+  if (s->windowcount == 0)
+    return;
+  for (i = 0; i < s->windowcount; i++)
+  {
+    p = (struct pkt *)slabptr(s->buffer) + (s->base + i) % SEQSPACE % WINDOWSIZE;
+    p->flags = (p->flags & ~SRMODE) | mode;
+  }
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void A_output(struct msg message)
+{
+  struct sender *s = Astate;
+  struct pkt *buffer;
+  struct pkt sendpkt;
+  int i;
+
+  /* if not blocked waiting on ACK */
+  if (s->windowcount < ccwindow(&s->cw))
+  {
+    if (TRACE > 1)
+      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
+
+    /* create packet */
+    sendpkt.seqnum = s->nextseq;
+    sendpkt.acknum = NOTINUSE;
+    for (i = 0; i < 20; i++)
+      sendpkt.payload[i] = message.data[i];
+    sendpkt.flags = (ecn ? ECT : 0) | s->mode;
+    sendpkt.checksum = ComputeChecksum(sendpkt);
+
+    /* put packet in window buffer, taken from the pool for the first one */
+    if (s->windowcount == 0)
+      s->buffer = slabget(BUFFERSIZE);
+    buffer = slabptr(s->buffer);
+    buffer[s->nextseq % WINDOWSIZE] = sendpkt;
+    s->windowcount++;
+
+    /* send out packet */
+    if (TRACE > 0)
+      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+    tolayer3(A, sendpkt);
+    rtosent(&s->rto, sendpkt.seqnum);
+
+    /* start timer if first packet in window */
+    if (s->windowcount == 1)
+      starttimer(A, rtotimeout(&s->rto));
+
+    s->nextseq = (s->nextseq + 1) % SEQSPACE;
+  }
+  /* if blocked,  window is full */
+  else
+  {
+    if (TRACE > 0)
+      printf("----A: New message arrives, send window is full\n");
+    connstats->window_full++;
+  }
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   In this practical this will always be an ACK as B never sends data.
+*/
+static void A_input(struct pkt packet)
+{
+  struct sender *s = Astate;
+  unsigned int newly;
+  int d, n;
+
+  /* if received ACK is not corrupted */
+  if (IsCorrupted(packet))
+  {
+    if (TRACE > 0)
+      printf("----A: corrupted ACK is received, do nothing!\n");
+    return;
+  }
+  if (TRACE > 0)
+    printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
+  connstats->total_ACKs_received++;
+
+  /* a cumulative ACK covers every packet up to the one it names */
+  d = (packet.acknum - s->base + SEQSPACE) % SEQSPACE;
+  newly = 0;
+  if (d < s->windowcount)
+    newly = ((packet.flags & SRMODE) ? BIT(d) : BELOW(d + 1)) & ~s->acked;
+  if (newly == 0)
+  {
+    if (TRACE > 0)
+      printf("----A: duplicate ACK received, do nothing!\n");
+    return;
+  }
+  if (TRACE > 0)
+    printf("----A: ACK %d is not a duplicate\n", packet.acknum);
+  connstats->new_ACKs++;
+  if (packet.flags & ECE)
+    ccmarked(&s->cw);
+
+  /* take a round trip sample if the packet being timed is among them */
+  if (s->rto.seq != -1 && (newly & BIT((s->rto.seq - s->base + SEQSPACE) % SEQSPACE)))
+    rtoacked(&s->rto);
+  n = count(newly);
+  ccacked(&s->cw, n);
+  while (n-- > 0)
+    s->timeouts -= s->timeouts / LOSSGAIN;
+  A_adapt(s);
+
+  /* slide the window past the packets ACKed from base on */
+  s->acked |= newly;
+  if (!(s->acked & BIT(0)))
+    return;
+  while (s->acked & BIT(0))
+  {
+    s->base = (s->base + 1) % SEQSPACE;
+    s->windowcount--;
+    s->acked >>= 1;
+  }
+
+  /* start timer again if there are still more unacked packets in window */
+  stoptimer(A);
+  if (s->windowcount > 0)
+    starttimer(A, rtotimeout(&s->rto));
+  else
+  {
+    /* nothing left to resend, give the buffer back to the pool */
+    slabput(s->buffer, BUFFERSIZE);
+    s->buffer = 0;
+  }
+}
+
+/* called when A's timer goes off */
+static void A_timerinterrupt(void)
+{
+  struct sender *s = Astate;
+  struct pkt *buffer = slabptr(s->buffer);
+  struct pkt burst[WINDOWSIZE];
+  int i, n = 0;
+
+  if (TRACE > 0)
+    printf("----A: time out,resend packets!\n");
+  rtoexpired(&s->rto);
+  cctimeout(&s->cw);
+  s->timeouts += (1 - s->timeouts) / LOSSGAIN;
+  A_adapt(s);
+
+  /* go-back-N resends every packet awaiting an ACK, selective repeat the
+     oldest one */
+  for (i = 0; i < s->windowcount && (s->mode == 0 || n == 0); i++)
+    if (!(s->acked & BIT(i)))
+    {
+      if (TRACE > 0)
+        printf("---A: resending packet %d\n", (s->base + i) % SEQSPACE);
+      burst[n++] = buffer[(s->base + i) % SEQSPACE % WINDOWSIZE];
+      if (s->rto.seq == (s->base + i) % SEQSPACE)
+        s->rto.seq = -1; /* its ACK will not tell which one got through */
+    }
+  tolayer3_burst(A, burst, n);
+  connstats->packets_resent += n;
+  if (s->windowcount > 0)
+    starttimer(A, rtotimeout(&s->rto));
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+static void A_init(void)
+{
+  struct sender *s = Astate;
+
+  s->base = 0; /* A starts with seq num 0, do not change this */
+  s->nextseq = 0;
+  s->windowcount = 0;
+  s->mode = 0; /* go-back-N until the timeouts say otherwise */
+  s->acked = 0;
+  s->timeouts = 0.0;
+  s->buffer = 0; /* no buffer until there is something to send */
+  rtoinit(&s->rto, rto_initial > 0 ? rto_initial : RTT, adaptive_rto);
+  ccinit(&s->cw, window_limit > 0 && window_limit < WINDOWSIZE ? window_limit : WINDOWSIZE, congestion_control);
+}
+
+/********* Receiver (B)  variables and procedures ************/
+
+/* receiver state of one connection, found through Bstate */
+struct receiver
+{
+  slabref buffer;               /* packets out of order by sequence number % WINDOWSIZE, while there are any */
+  unsigned char expectedseqnum; /* the sequence number expected next by the receiver */
+  unsigned short received;      /* packets held, by distance from it */
+};
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+static void B_input(struct pkt packet)
+{
+  struct receiver *r = Bstate;
+  struct pkt *buffer;
+  struct pkt sendpkt;
+  int i, d;
+
+  /* corrupted packets are not ACKed, in either mode */
+  if (IsCorrupted(packet))
+  {
+    if (TRACE > 0)
+      printf("----B: packet corrupted, do not send ACK\n");
+    return;
+  }
+
+  /* take it if it is the one expected, or in selective repeat mode if it
+     is in the receive window and not held already */
+  d = (packet.seqnum - r->expectedseqnum + SEQSPACE) % SEQSPACE;
+  if (d == 0 || ((packet.flags & SRMODE) && d < WINDOWSIZE && !(r->received & BIT(d))))
+  {
+    if (TRACE > 0)
+      printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
+    connstats->packets_received++;
+
+    if (d > 0)
+    { /* hold it until the packets before it are in */
+      if (r->received == 0)
+        r->buffer = slabget(BUFFERSIZE);
+      buffer = slabptr(r->buffer);
+      buffer[packet.seqnum % WINDOWSIZE] = packet;
+      r->received |= BIT(d);
+    }
+    else
+    {
+      /* deliver it and the packets held after it to receiving application */
+      tolayer5(B, packet.payload);
+      r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+      r->received >>= 1;
+      while (r->received & BIT(0))
+      {
+        buffer = slabptr(r->buffer);
+        tolayer5(B, buffer[r->expectedseqnum % WINDOWSIZE].payload);
+        r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+        r->received >>= 1;
+      }
+      if (r->received == 0 && r->buffer != 0)
+      {
+        slabput(r->buffer, BUFFERSIZE);
+        r->buffer = 0;
+      }
+    }
+  }
+  else if (TRACE > 0)
+    printf("----B: packet %d not taken, send ACK!\n", packet.seqnum);
+
+  /* selective repeat ACKs the packet itself, go-back-N the last one in
+     order; the ACK says which it is */
+  if (packet.flags & SRMODE)
+    sendpkt.acknum = packet.seqnum;
+  else
+    sendpkt.acknum = (r->expectedseqnum + SEQSPACE - 1) % SEQSPACE;
+  sendpkt.seqnum = NOTINUSE;
+  sendpkt.flags = (packet.flags & SRMODE) | ((packet.flags & CE) ? ECE : 0);
+
+  /* we don't have any data to send.  fill payload with 0's */
+  for (i = 0; i < 20; i++)
+    sendpkt.payload[i] = '0';
+
+  /* computer checksum */
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+
+  /* send out packet */
+  tolayer3(B, sendpkt);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+static void B_init(void)
+{
+  struct receiver *r = Bstate;
+
+  r->expectedseqnum = 0;
+  r->received = 0;
+  r->buffer = 0;
+}
+
+/******************************************************************************
+ * The following functions need be completed only for bi-directional messages *
+ *****************************************************************************/
+
+/* Note that with simplex transfer from a-to-B, there is no B_output() */
+static void B_output(struct msg message)
+{
+}
+
+/* called when B's timer goes off */
+static void B_timerinterrupt(void)
+{
+}
+
+const struct protocol hybrid_protocol = {
+    "hybrid", sizeof(struct sender), sizeof(struct receiver), WINDOWSIZE, RTT, SWITCHING, 0,
+    A_init, B_init, A_input, B_input, A_output, B_output, A_timerinterrupt, B_timerinterrupt, NULL, NULL};
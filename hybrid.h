@@ -0,0 +1,5 @@
+/* Go-back-N / selective repeat hybrid protocol entities */
+extern const struct protocol hybrid_protocol;
+
+/* times a sender changed its mode, by the thread */
+extern _Thread_local counter modeswitches;
@@ -0,0 +1,116 @@
+#include "emulator.h"
+#include "slab.h"
+#include "rto.h"
+#include "rack.h"
+
+struct rackstate
+{
+  clocktime sent[RACKSLOTS]; /* when the packet in each slot was last sent */
+  clocktime xmit;            /* when the last sent of the packets known delivered was sent */
+  float rtt;                 /* its round trip */
+  float srtt;                /* smoothed round trip, 0 until the first sample */
+  unsigned short resent;     /* slots whose packet was resent, so whose ACK is ambiguous */
+  unsigned char reordered;   /* set once an ACK came out of order */
+  unsigned char probed;      /* set after a probe, until the next new ACK */
+  unsigned char armed;       /* set while the timer is armed for a probe */
+};
+
+_Thread_local counter rackprobes, racklosses;
+
+static struct rackstate *state(slabref *k)
+{
+  struct rackstate *st;
+
+  if (*k == 0)
+  {
+    *k = slabget(sizeof(struct rackstate));
+    st = slabptr(*k);
+    st->xmit = -1;
+    st->rtt = st->srtt = 0.0;
+    st->resent = 0;
+    st->reordered = st->probed = st->armed = 0;
+  }
+  return slabptr(*k);
+}
+
+void racksent(slabref *k, int slot, int resent)
+{
+  struct rackstate *st;
+
+  if (!rack)
+    return;
+  st = state(k);
+  st->sent[slot] = CLOCK(gettime());
+  if (resent)
+    st->resent |= 1u << slot;
+  else
+    st->resent &= ~(1u << slot);
+}
+
+void rackacked(slabref *k, int slot)
+{
+  struct rackstate *st;
+  double rtt;
+
+  if (!rack || *k == 0)
+    return;
+  st = slabptr(*k);
+  st->probed = 0;
+  if (st->resent & (1u << slot))
+    return; /* which of its sends got through is not known */
+  if (st->sent[slot] < st->xmit)
+    st->reordered = 1;
+  else
+    st->xmit = st->sent[slot];
+  rtt = gettime() - UNITS(st->sent[slot]);
+  st->rtt = rtt;
+  st->srtt = st->srtt == 0.0 ? rtt : st->srtt + (rtt - st->srtt) / 8;
+}
+
+int racklost(slabref *k, int slot)
+{
+  struct rackstate *st;
+
+  if (!rack || *k == 0)
+    return 0;
+  st = slabptr(*k);
+  if (st->sent[slot] >= st->xmit)
+    return 0;
+  if (st->reordered && gettime() < UNITS(st->sent[slot]) + st->rtt * 1.25)
+    return 0;
+  racklosses++;
+  return 1;
+}
+
+double racktimeout(slabref *k, struct rto *r)
+{
+  struct rackstate *st;
+  double rto = rtotimeout(r);
+
+  if (!rack)
+    return rto;
+  st = state(k);
+  st->armed = !st->probed && st->srtt > 0 && 2 * st->srtt < rto;
+  return st->armed ? 2 * st->srtt : rto;
+}
+
+int rackexpired(slabref *k)
+{
+  struct rackstate *st;
+
+  if (!rack || *k == 0)
+    return 0;
+  st = slabptr(*k);
+  if (!st->armed)
+    return 0;
+  st->armed = 0;
+  st->probed = 1;
+  rackprobes++;
+  return 1;
+}
+
+void rackfree(slabref *k)
+{
+  slabput(*k, sizeof(struct rackstate));
+  *k = 0;
+}
@@ -0,0 +1,37 @@
+/* Time-based loss detection (RACK) and tail loss probes (TLP) of a sender,
+   when rack is set.  The sender notes when it sends the packet in each
+   slot of its window.  A packet is taken for lost once a packet sent after
+   it has been ACKed; once ACKs have been seen out of order, also a
+   reordering window of a quarter of the round trip must have passed since.
+   The timer is armed for a probe at twice the smoothed round trip when
+   that comes before the retransmission timeout: on it the sender resends
+   its last packet, once until the next new ACK, and the timer is armed
+   again for the timeout.  The state is a block from the pool, made when
+   the sender sends with nothing awaiting an ACK and given back once
+   everything is ACKed, so its round trip estimate starts afresh with
+   each busy period; without rack every call leaves the sender as it
+   was.  Include after slab.h, emulator.h and rto.h. */
+
+#define RACKSLOTS 16 /* slots of a window it can keep */
+
+/* probes sent and packets taken for lost, by the thread */
+extern _Thread_local counter rackprobes, racklosses;
+
+/* the packet in the slot was sent now, again if resent is set */
+extern void racksent(slabref *k, int slot, int resent);
+
+/* the packet in the slot was ACKed */
+extern void rackacked(slabref *k, int slot);
+
+/* whether the packet in the slot, still awaiting an ACK, is lost; each
+   one found is counted in racklosses */
+extern int racklost(slabref *k, int slot);
+
+/* the time to arm the timer for, the probe's or the timeout's */
+extern double racktimeout(slabref *k, struct rto *r);
+
+/* the timer went off: whether it was for a probe */
+extern int rackexpired(slabref *k);
+
+/* nothing awaits an ACK any more: give the state back to the pool */
+extern void rackfree(slabref *k);
@@ -0,0 +1,244 @@
+#include <stddef.h>
+#include <math.h>
+#include "emulator.h"
+#include "event.h"
+#include "router.h"
+
+/* RED, after Floyd and Jacobson, with thresholds set from the queue limit */
+#define REDWEIGHT 0.002 /* weight of a new sample in the average */
+#define REDMAXP 0.1     /* drop probability at the upper threshold */
+
+/* CoDel, after Nichols and Jacobson, with the interval set to the
+   protocols' round trip time */
+#define CODELTARGET 1.0    /* acceptable time to wait in the queue */
+#define CODELINTERVAL 16.0 /* how long it may be exceeded before dropping */
+
+extern double jimsrand(void);
+
+const char *disciplines[] = {"droptail", "red", "codel", NULL};
+
+void routerinit(struct router *r, double rate, int limit, int discipline)
+{
+  r->rate = rate;
+  r->limit = limit;
+  r->discipline = discipline;
+  r->length = 0;
+  r->busy = 0;
+  r->head = r->tail = NULL;
+  r->redavg = 0.0;
+  r->idlesince = 0.0;
+  r->redcount = -1;
+  r->dropping = 0;
+  r->codelcount = r->lastcount = 0;
+  r->firstabove = 0.0;
+  r->dropnext = 0.0;
+  r->arrivals = 0;
+  r->drops = 0;
+  r->marks = 0;
+  r->maxlength = 0;
+  r->area = 0.0;
+  r->lastchange = 0.0;
+  r->since = 0.0;
+}
+
+/* account for the time spent at the current length, then change it */
+static void setlength(struct router *r, int length)
+{
+  double now = gettime();
+
+  r->area += r->length * (now - r->lastchange);
+  r->lastchange = now;
+  r->length = length;
+  if (length > r->maxlength)
+    r->maxlength = length;
+  if (length == 0)
+    r->idlesince = now;
+}
+
+double routermean(struct router *r)
+{
+  double now = gettime();
+  double area = r->area + r->length * (now - r->lastchange);
+
+  return now > r->since ? area / (now - r->since) : 0.0;
+}
+
+void routerclear(struct router *r, double now)
+{
+  r->arrivals = 0;
+  r->drops = 0;
+  r->marks = 0;
+  r->maxlength = r->length;
+  r->area = 0.0;
+  r->lastchange = now;
+  r->since = now;
+}
+
+/* should RED drop an arriving packet? */
+static int reddrop(struct router *r)
+{
+  double minth = r->limit / 4.0, maxth = 3 * r->limit / 4.0;
+  double pb, pa;
+
+  if (r->length > 0)
+    r->redavg += REDWEIGHT * (r->length - r->redavg);
+  else /* decay the average as if small packets had gone by while idle */
+    r->redavg *= pow(1 - REDWEIGHT, (gettime() - r->idlesince) * r->rate);
+
+  if (r->redavg < minth)
+  {
+    r->redcount = -1;
+    return 0;
+  }
+  if (r->redavg >= maxth)
+  {
+    r->redcount = 0;
+    return 1;
+  }
+  r->redcount++;
+  pb = REDMAXP * (r->redavg - minth) / (maxth - minth);
+  pa = r->redcount * pb < 1 ? pb / (1 - r->redcount * pb) : 1.0;
+  if (jimsrand() < pa)
+  {
+    r->redcount = 0;
+    return 1;
+  }
+  return 0;
+}
+
+/* signal congestion with a packet: mark it if it can take a mark, 1, or drop it */
+static int mark(struct router *r, struct event *p)
+{
+  if (!(p->pktptr->flags & ECT))
+    return 0;
+  p->pktptr->flags |= CE;
+  r->marks++;
+  return 1;
+}
+
+void routerenqueue(struct router *r, struct event *p)
+{
+  r->arrivals++;
+  if (r->length >= r->limit || (r->discipline == RED && reddrop(r) && !mark(r, p)))
+  {
+    r->drops++;
+    routerdrop(p);
+    return;
+  }
+  if (r->discipline == DROPTAIL && 2 * r->length >= r->limit)
+    mark(r, p);
+  p->next = NULL;
+  if (r->tail == NULL)
+    r->head = p;
+  else
+    r->tail->next = p;
+  r->tail = p;
+  setlength(r, r->length + 1);
+}
+
+void routermove(struct router *r, ptrdiff_t delta)
+{
+  struct event *p;
+
+  if (r->head == NULL)
+    return;
+  r->head = (struct event *)((char *)r->head + delta);
+  r->tail = (struct event *)((char *)r->tail + delta);
+  for (p = r->head; p->next != NULL; p = p->next)
+    p->next = (struct event *)((char *)p->next + delta);
+}
+
+/* take the head packet off, and tell whether CoDel may drop it.  While a
+   packet waits its evtime is the time it arrived. */
+static struct event *take(struct router *r, int *oktodrop)
+{
+  struct event *p = r->head;
+  double now = gettime();
+
+  *oktodrop = 0;
+  if (p == NULL)
+  {
+    r->firstabove = 0.0;
+    return NULL;
+  }
+  r->head = p->next;
+  if (r->head == NULL)
+    r->tail = NULL;
+  if (now - UNITS(p->evtime) < CODELTARGET || r->length <= 1)
+    r->firstabove = 0.0;
+  else if (r->firstabove == 0.0)
+    r->firstabove = now + CODELINTERVAL;
+  else if (now >= r->firstabove)
+    *oktodrop = 1;
+  return p;
+}
+
+/* a packet taken off the queue is marked, 1, or dropped instead of sent */
+static int codeldrop(struct router *r, struct event *p)
+{
+  if (mark(r, p))
+    return 1;
+  r->drops++;
+  setlength(r, r->length - 1);
+  routerdrop(p);
+  return 0;
+}
+
+struct event *routerdequeue(struct router *r)
+{
+  struct event *p;
+  double now = gettime();
+  int ok;
+
+  if (r->discipline != CODEL)
+  {
+    p = r->head;
+    if (p != NULL && (r->head = p->next) == NULL)
+      r->tail = NULL;
+  }
+  else
+  {
+    p = take(r, &ok);
+    if (r->dropping)
+    {
+      if (!ok)
+        r->dropping = 0;
+      while (r->dropping && now >= r->dropnext)
+      {
+        r->codelcount++;
+        if (codeldrop(r, p))
+        { /* marked, it goes on */
+          r->dropnext += CODELINTERVAL / sqrt(r->codelcount);
+          break;
+        }
+        p = take(r, &ok);
+        if (!ok)
+          r->dropping = 0;
+        else
+          r->dropnext += CODELINTERVAL / sqrt(r->codelcount);
+      }
+    }
+    else if (ok)
+    {
+      if (!codeldrop(r, p))
+        p = take(r, &ok);
+      r->dropping = 1;
+      /* start near the drop rate that was needed last time */
+      if (r->codelcount - r->lastcount > 1 && now - r->dropnext < 16 * CODELINTERVAL)
+        r->codelcount = r->codelcount - r->lastcount;
+      else
+        r->codelcount = 1;
+      r->dropnext = now + CODELINTERVAL / sqrt(r->codelcount);
+      r->lastcount = r->codelcount;
+    }
+  }
+  if (p != NULL)
+    r->busy = 1;
+  return p;
+}
+
+void routersent(struct router *r)
+{
+  r->busy = 0;
+  setlength(r, r->length - 1);
+}
@@ -0,0 +1,70 @@
+/* A store-and-forward router in front of a link.  Packets wait in its
+   queue and are sent on in the order they came, one every 1/rate time
+   units.  The queue discipline decides which packets are dropped:
+   drop-tail drops arrivals that find the queue full, RED drops arrivals
+   early with a probability that grows with the average queue length, and
+   CoDel drops at the head while packets have waited too long for too
+   long.  Packets marked ECN capable are marked congestion experienced
+   instead of being dropped early, and drop-tail marks them once the
+   queue is half full; only a full queue still drops them. */
+
+#include <stddef.h>
+
+struct event;
+
+/* queue disciplines */
+#define DROPTAIL 0
+#define RED 1
+#define CODEL 2
+
+struct router
+{
+  double rate;                /* packets sent per time unit */
+  int limit;                  /* packets the queue holds, with the one being sent */
+  int discipline;
+  int length;                 /* packets in it now, with the one being sent */
+  int busy;                   /* set while a packet is being sent */
+  struct event *head, *tail;  /* events of the packets waiting, chained through next */
+
+  double redavg;              /* RED: average queue length */
+  double idlesince;           /* RED: when the queue last emptied */
+  int redcount;               /* RED: packets queued since the last drop */
+
+  int dropping;               /* CoDel: in the dropping state */
+  int codelcount, lastcount;  /* CoDel: drops in this and the last dropping state */
+  double firstabove;          /* CoDel: when the delay has been above target for an interval, 0 if below */
+  double dropnext;            /* CoDel: when to drop next */
+
+  unsigned long arrivals;     /* packets that reached the router */
+  unsigned long drops;        /* of them, dropped by the queue discipline */
+  unsigned long marks;        /* and marked congestion experienced */
+  int maxlength;              /* longest the queue has been */
+  double area;                /* integral of length over time, for the mean */
+  double lastchange;          /* when length last changed */
+  double since;               /* when the counts above started */
+};
+
+extern const char *disciplines[]; /* names of the disciplines, by number */
+
+extern void routerinit(struct router *r, double rate, int limit, int discipline);
+
+/* queue the event of an arriving packet, or drop it */
+extern void routerenqueue(struct router *r, struct event *p);
+
+/* take the next packet to send off the queue, NULL if none is waiting.
+   It keeps its place in the queue until routersent(). */
+extern struct event *routerdequeue(struct router *r);
+extern void routersent(struct router *r);
+
+/* mean queue length up to now */
+extern double routermean(struct router *r);
+
+/* start the counts afresh at time now, as when a warm-up period is over */
+extern void routerclear(struct router *r, double now);
+
+/* the events in the queue have moved by delta bytes, as when the slab pool
+   they are in is restored from a snapshot: chain them up again */
+extern void routermove(struct router *r, ptrdiff_t delta);
+
+/* supplied by the emulator: free a packet the router dropped */
+extern void routerdrop(struct event *p);
@@ -0,0 +1,63 @@
+#include "emulator.h"
+#include "rto.h"
+
+#define MINRTO 2.0    /* bounds of the adaptive timeout */
+#define MAXRTO 1024.0
+
+void rtoinit(struct rto *r, double rtt, int adaptive)
+{
+  r->adaptive = adaptive;
+  r->srtt = 0.0;
+  r->rttvar = 0.0;
+  r->timeout = rtt;
+  r->seq = -1;
+}
+
+double rtotimeout(struct rto *r)
+{
+  return r->timeout;
+}
+
+void rtosent(struct rto *r, int seq)
+{
+  if (!r->adaptive || r->seq != -1)
+    return;
+  r->seq = seq;
+  r->sent = CLOCK(gettime());
+}
+
+void rtoacked(struct rto *r)
+{
+  double rtt, err;
+
+  if (r->seq == -1)
+    return;
+  rtt = gettime() - UNITS(r->sent);
+  r->seq = -1;
+  if (r->srtt == 0.0)
+  { /* first sample */
+    r->srtt = rtt;
+    r->rttvar = rtt / 2;
+  }
+  else
+  {
+    err = rtt - r->srtt;
+    r->srtt += err / 8;
+    r->rttvar += ((err < 0 ? -err : err) - r->rttvar) / 4;
+  }
+  r->timeout = r->srtt + 4 * r->rttvar;
+  if (r->timeout < MINRTO)
+    r->timeout = MINRTO;
+  if (r->timeout > MAXRTO)
+    r->timeout = MAXRTO;
+}
+
+void rtoexpired(struct rto *r)
+{
+  if (!r->adaptive)
+    return;
+  r->seq = -1; /* the timed packet will be resent, so its ACK is ambiguous */
+  r->timeout *= 2;
+  if (r->timeout > MAXRTO)
+    r->timeout = MAXRTO;
+}
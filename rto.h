@@ -0,0 +1,27 @@
+/* Retransmission timeout of a sender.  It stays at the protocol's RTT
+   unless it is adaptive, as it is for every sender when adaptive_rto is
+   set; then it follows the measured round trips
+   (Jacobson/Karels, never sampling a retransmitted packet) and doubles
+   on every timeout until a new sample comes in. */
+
+struct rto
+{
+  clocktime sent;  /* when the packet being timed was sent */
+  float srtt;      /* smoothed round trip time, 0 until the first sample */
+  float rttvar;    /* its mean deviation */
+  float timeout;   /* the timeout to use */
+  signed char seq; /* its sequence number, -1 if none is being timed */
+  unsigned char adaptive;
+};
+
+extern void rtoinit(struct rto *r, double rtt, int adaptive);
+extern double rtotimeout(struct rto *r);
+
+/* a new packet was sent: time it, unless another one is being timed */
+extern void rtosent(struct rto *r, int seq);
+
+/* the packet being timed was ACKed: take a round trip sample */
+extern void rtoacked(struct rto *r);
+
+/* the timer went off: back off and stop timing */
+extern void rtoexpired(struct rto *r);
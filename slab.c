@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "slab.h"
+
+/* ******************************************************************
+   Slab pool.  One large anonymous mapping is reserved up front and
+   blocks are carved from it in order; the kernel only backs the pages
+   that are touched.  Freed blocks go on a free list for their size and
+   are handed out again before any new memory is carved.  Blocks larger
+   than the biggest size class (the connection table and the like) are
+   aligned to a cache line and are only given back by slabreset().
+   Every pool is listed in pools[], so a block freed by another thread
+   than its own is found a home: it is pushed on the pool's returned
+   list, and the owner moves it to its free lists in slabdrain().
+**********************************************************************/
+
+#define GRAIN 16                     /* block sizes are rounded up to this */
+#define NCLASSES SLABCLASSES         /* size classes up to GRAIN * NCLASSES bytes */
+#define LINE 64                      /* alignment of large blocks */
+#define RESERVE ((size_t)GRAIN << 32) /* every block can be named by a slabref */
+#define MINRESERVE ((size_t)1 << 26)  /* settle for less under an address space limit */
+#define MAXPOOLS 1024                /* pools in use at once */
+
+struct freeblock
+{
+  struct freeblock *next;
+  size_t class; /* on a returned list, its size class */
+};
+
+/* what other threads need to know of a thread's pool */
+struct pool
+{
+  char *arena;
+  size_t reserved;
+  _Atomic(struct freeblock *) returned; /* blocks other threads freed */
+};
+
+static _Atomic(struct pool *) pools[MAXPOOLS]; /* the pools of the threads, NULL for a free slot */
+static atomic_int npools;                      /* slots used so far */
+
+static _Thread_local char *arena;                           /* start of the reserved mapping */
+static _Thread_local size_t reserved;                       /* its size */
+static _Thread_local size_t top;                            /* bytes carved so far */
+static _Thread_local size_t live, peak;                     /* bytes in blocks not yet freed */
+static _Thread_local struct freeblock *freelist[NCLASSES + 1]; /* free blocks by size class */
+static _Thread_local size_t mapped;                         /* bytes mapped from a snapshot */
+static _Thread_local struct pool self;                      /* the thread's entry in pools[] */
+static _Thread_local int slot;                              /* and where */
+
+/* list the thread's pool, so other threads can give its blocks back */
+static void enlist(void)
+{
+  struct pool *expected;
+  int n;
+
+  self.arena = arena;
+  self.reserved = reserved;
+  atomic_store(&self.returned, NULL);
+  for (slot = 0;; slot++)
+  {
+    expected = NULL;
+    if (slot == MAXPOOLS)
+    {
+      printf("too many threads for the slab pool.");
+      exit(EXIT_FAILURE);
+    }
+    if (atomic_compare_exchange_strong(&pools[slot], &expected, &self))
+      break;
+  }
+  n = atomic_load(&npools);
+  while (n <= slot && !atomic_compare_exchange_weak(&npools, &n, slot + 1))
+    ;
+}
+
+/* a block of another thread's pool: push it on that pool's returned list */
+static void giveback(struct freeblock *b, size_t class)
+{
+  struct pool *o;
+  int i, n = atomic_load(&npools);
+
+  for (i = 0; i < n; i++)
+  {
+    o = atomic_load(&pools[i]);
+    if (o != NULL && (char *)b >= o->arena && (char *)b < o->arena + o->reserved)
+      break;
+  }
+  if (i == n)
+  {
+    printf("a block freed to the slab pool is in none of its pools.");
+    exit(EXIT_FAILURE);
+  }
+  b->class = class;
+  b->next = atomic_load(&o->returned);
+  while (!atomic_compare_exchange_weak(&o->returned, &b->next, b))
+    ;
+}
+
+static void reserve(void)
+{
+  for (reserved = RESERVE; reserved >= MINRESERVE; reserved /= 2)
+  {
+    arena = mmap(NULL, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena != MAP_FAILED)
+      break;
+  }
+  if (arena == MAP_FAILED)
+  {
+    printf("reserving memory for the slab pool failed.");
+    exit(EXIT_FAILURE);
+  }
+  top = GRAIN; /* the first grain stays unused so no block has slabref 0 */
+  enlist();
+}
+
+void *slaballoc(size_t size)
+{
+  size_t class = (size + GRAIN - 1) / GRAIN;
+  struct freeblock *p;
+
+  if (arena == NULL)
+    reserve();
+  if (class == 0)
+    class = 1;
+  live += class * GRAIN;
+  if (live > peak)
+    peak = live;
+
+  if (class <= NCLASSES && freelist[class] != NULL)
+  {
+    p = freelist[class];
+    freelist[class] = p->next;
+    return p;
+  }
+  if (class > NCLASSES)
+    top = (top + LINE - 1) & ~(size_t)(LINE - 1);
+  if (top + class * GRAIN > reserved)
+  {
+    printf("memory allocation from the slab pool failed.");
+    exit(EXIT_FAILURE);
+  }
+  p = (struct freeblock *)(arena + top);
+  top += class * GRAIN;
+  return p;
+}
+
+void slabfree(void *p, size_t size)
+{
+  size_t class = (size + GRAIN - 1) / GRAIN;
+  struct freeblock *b = p;
+
+  if (p == NULL)
+    return;
+  if (class == 0)
+    class = 1;
+  if ((char *)p < arena || (char *)p >= arena + reserved)
+  {
+    giveback(b, class);
+    return;
+  }
+  live -= class * GRAIN;
+  if (class > NCLASSES)
+    return;
+  b->next = freelist[class];
+  freelist[class] = b;
+}
+
+void slabdrain(void)
+{
+  struct freeblock *b, *next;
+
+  if (arena == NULL)
+    return;
+  for (b = atomic_exchange(&self.returned, NULL); b != NULL; b = next)
+  {
+    next = b->next;
+    live -= b->class * GRAIN;
+    if (b->class <= NCLASSES)
+    {
+      b->next = freelist[b->class];
+      freelist[b->class] = b;
+    }
+  }
+}
+
+slabref slabget(size_t size)
+{
+  char *p = slaballoc(size);
+
+  if (p < arena || p >= arena + reserved)
+  { /* its slabref would name a block of this pool instead */
+    printf("a block of another thread's slab pool was handed out.");
+    exit(EXIT_FAILURE);
+  }
+  return (slabref)((p - arena) / GRAIN);
+}
+
+void slabput(slabref r, size_t size)
+{
+  slabfree(slabptr(r), size);
+}
+
+void *slabptr(slabref r)
+{
+  if (r == 0)
+    return NULL;
+  return arena + (size_t)r * GRAIN;
+}
+
+void slabreset(void)
+{
+  int i;
+
+  if (arena == NULL)
+    return;
+  if (mapped > 0)
+  { /* pages of the snapshot would read as it again, so map zeroes over them */
+    mmap(arena, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    mapped = 0;
+  }
+  madvise(arena, top, MADV_DONTNEED); /* hand the pages back, they read as zero again */
+  top = GRAIN;
+  live = peak = 0;
+  for (i = 0; i <= NCLASSES; i++)
+    freelist[i] = NULL;
+  atomic_store(&self.returned, NULL);
+}
+
+void slabrelease(void)
+{
+  if (arena == NULL)
+    return;
+  slabreset();
+  atomic_store(&pools[slot], NULL);
+  munmap(arena, reserved);
+  arena = NULL;
+}
+
+size_t slabsize(void)
+{
+  return top;
+}
+
+size_t slabpeak(void)
+{
+  return peak;
+}
+
+char *slabbase(void)
+{
+  if (arena == NULL)
+    reserve();
+  return arena;
+}
+
+void slabsave(struct slabstate *s)
+{
+  int i;
+
+  s->base = slabbase();
+  s->top = top;
+  s->live = live;
+  s->peak = peak;
+  for (i = 0; i <= NCLASSES; i++)
+    s->freelist[i] = freelist[i];
+}
+
+ptrdiff_t slabload(const struct slabstate *s, int fd, long offset)
+{
+  ptrdiff_t delta;
+  struct freeblock *b;
+  int i;
+
+  slabbase();
+  slabreset();
+  if (s->top > reserved ||
+      mmap(arena, s->top, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED)
+  {
+    printf("mapping the snapshot into the slab pool failed.");
+    exit(EXIT_FAILURE);
+  }
+  mapped = s->top;
+  top = s->top;
+  live = s->live;
+  peak = s->peak;
+  delta = arena - s->base;
+  for (i = 0; i <= NCLASSES; i++)
+  { /* the free lists run through the blocks */
+    freelist[i] = s->freelist[i] == NULL ? NULL : (struct freeblock *)((char *)s->freelist[i] + delta);
+    for (b = freelist[i]; b != NULL && b->next != NULL; b = b->next)
+      b->next = (struct freeblock *)((char *)b->next + delta);
+  }
+  return delta;
+}
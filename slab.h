@@ -0,0 +1,51 @@
+/* A pool of small blocks shared by the emulator and the protocols.  The
+   blocks are carved from one reserved arena and recycled through a free
+   list per size, so a connection only holds buffer memory while it has
+   data outstanding.  Every thread has a pool of its own, and a slabref
+   is resolved by the thread that allocated the block.  A block another
+   thread frees goes back to the pool it came from, which takes it in
+   at its next slabdrain(). */
+
+#include <stddef.h>
+
+/* a block named by its position in the pool, 0 for none.  Half the size
+   of a pointer, for the per-connection state. */
+typedef unsigned int slabref;
+
+extern void *slaballoc(size_t size);
+extern void slabfree(void *p, size_t size);
+
+extern slabref slabget(size_t size);
+extern void slabput(slabref r, size_t size);
+extern void *slabptr(slabref r);
+
+/* put the blocks other threads gave back on the free lists */
+extern void slabdrain(void);
+
+/* forget every block, ready for a fresh run */
+extern void slabreset(void);
+
+/* forget every block and give back the reserved memory */
+extern void slabrelease(void);
+
+/* bytes carved from the arena, and the most there were live at once */
+extern size_t slabsize(void);
+extern size_t slabpeak(void);
+
+/* Snapshots.  The pool is saved as its carved bytes, from slabbase() up to
+   slabsize(), and what slabsave() fills in.  slabload() maps such an image
+   from a file over the arena, copy on write, in place of every block, and
+   returns how far the blocks moved: each pointer into the pool kept in
+   them or elsewhere must be moved by as much. */
+#define SLABCLASSES 64
+
+struct slabstate
+{
+  char *base;                         /* where the arena was */
+  size_t top, live, peak;
+  void *freelist[SLABCLASSES + 1];
+};
+
+extern char *slabbase(void);
+extern void slabsave(struct slabstate *s);
+extern ptrdiff_t slabload(const struct slabstate *s, int fd, long offset);
@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "emulator.h"
+#include "slab.h"
+#include "rto.h"
+#include "cc.h"
+#include "rack.h"
 #include "sr.h"
 
 /* ******************************************************************
@@ -20,6 +24,9 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - ACKs also carry B's window base in the sequence number field, and
+   A takes every packet before it for ACKed, so a lost ACK costs a
+   resend only if no later ACK comes before the timeout.
 **********************************************************************/
 
 #define RTT 16.0      /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
@@ -27,12 +34,21 @@
 #define SEQSPACE 12   /* the min sequence space for SR must be at least 2 * windowsize */
 #define NOTINUSE (-1) /* used to fill header fields that are not being used */
 
+#define BUFFERSIZE (WINDOWSIZE * sizeof(struct pkt))
+#define BIT(n) (1u << (n)) /* flags for buffer slots and sequence numbers are kept in bitmaps */
+#define BELOW(n) (BIT(n) - 1)
+/* the buffer slots of n packets from the one in slot b on */
+#define SLOTS(n, b) (((BELOW(n) << (b)) | (BELOW(n) >> (WINDOWSIZE - (b)))) & BELOW(WINDOWSIZE))
+#if SEQSPACE > 16
+#error "the bitmaps in struct sender and struct receiver hold at most 16 sequence numbers"
+#endif
+
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
    original checksum.  This procedure must generate a different checksum to the original if
    the packet is corrupted.
 */
-int ComputeChecksum(struct pkt packet)
+static int ComputeChecksum(struct pkt packet)
 {
   int checksum = 0;
   int i;
@@ -45,7 +61,7 @@ int ComputeChecksum(struct pkt packet)
   return checksum;
 }
 
-bool IsCorrupted(struct pkt packet)
+static bool IsCorrupted(struct pkt packet)
 {
   if (packet.checksum == ComputeChecksum(packet))
     return (false);
@@ -53,150 +69,223 @@ bool IsCorrupted(struct pkt packet)
     return (true);
 }
 
+static int count(unsigned int bits)
+{
+  int n = 0;
+
+  for (; bits != 0; bits &= bits - 1)
+    n++;
+  return n;
+}
+
 /********* Sender (A) variables and functions ************/
 
-/* State variables for sender */
-static struct pkt buffer[WINDOWSIZE]; /* array for storing packets waiting for ACK */
-static bool acked[WINDOWSIZE];        /* indicates whether packet has been ACKed */
-static int windowbase;                /* base sequence number of the window */
-static int A_nextseqnum;              /* the next sequence number to be used by the sender */
-static int windowcount;               /* the number of packets currently awaiting an ACK */
-static int oldest_unacked;            /* sequence number of the oldest unacked packet */
-static bool in_window[SEQSPACE];      /* tracks if a sequence number is in the current window */
+/* State variables for sender, one set per connection found through Astate */
+struct sender
+{
+  slabref buffer;             /* array for storing packets waiting for ACK, while there are any */
+  unsigned short acked;       /* indicates whether packet has been ACKed, per buffer slot */
+  unsigned short in_window;   /* tracks if a sequence number is in the current window */
+  unsigned char windowbase;   /* base sequence number of the window */
+  unsigned char A_nextseqnum; /* the next sequence number to be used by the sender */
+  unsigned char windowcount;  /* the number of packets currently awaiting an ACK */
+  signed char oldest_unacked; /* sequence number of the oldest unacked packet */
+  slabref rack;               /* loss detection by time and tail loss probes, with rack */
+  struct rto rto;             /* retransmission timeout */
+  struct cwnd cw;             /* congestion window */
+};
 
 /* Find the oldest unacknowledged packet to time */
-static void find_oldest_unacked(void)
+static void find_oldest_unacked(struct sender *s)
 {
   int i;
   int seq;
-  oldest_unacked = -1;
+  s->oldest_unacked = -1;
 
   /* Start from the windowbase and find the first unacked packet */
-  for (i = 0; i < windowcount; i++)
+  for (i = 0; i < s->windowcount; i++)
   {
-    seq = (windowbase + i) % SEQSPACE;
-    if (!acked[seq % WINDOWSIZE] && in_window[seq])
+    seq = (s->windowbase + i) % SEQSPACE;
+    if (!(s->acked & BIT(seq % WINDOWSIZE)) && (s->in_window & BIT(seq)))
     {
-      oldest_unacked = seq;
+      s->oldest_unacked = seq;
       return;
     }
   }
 }
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+static void A_output(struct msg message)
 {
+  struct sender *s = Astate;
+  struct pkt *buffer;
   struct pkt sendpkt;
   int i;
   int index;
 
   /* if not blocked waiting on ACK */
-  if (windowcount < WINDOWSIZE)
+  if (s->windowcount < ccwindow(&s->cw))
   {
     if (TRACE > 1)
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
 
     /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
+    sendpkt.seqnum = s->A_nextseqnum;
     sendpkt.acknum = NOTINUSE;
     for (i = 0; i < 20; i++)
       sendpkt.payload[i] = message.data[i];
+    sendpkt.flags = ecn ? ECT : 0;
     sendpkt.checksum = ComputeChecksum(sendpkt);
 
-    /* put packet in window buffer */
-    index = A_nextseqnum % WINDOWSIZE;
+    /* put packet in window buffer, taken from the pool for the first one */
+    if (s->windowcount == 0)
+      s->buffer = slabget(BUFFERSIZE);
+    buffer = slabptr(s->buffer);
+    index = s->A_nextseqnum % WINDOWSIZE;
     buffer[index] = sendpkt;
-    acked[index] = false;
-    in_window[A_nextseqnum] = true;
-    windowcount++;
+    s->acked &= ~BIT(index);
+    s->in_window |= BIT(s->A_nextseqnum);
+    s->windowcount++;
 
     /* send out packet */
     if (TRACE > 0)
       printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
     tolayer3(A, sendpkt);
+    rtosent(&s->rto, sendpkt.seqnum);
+    racksent(&s->rack, index, 0);
 
     /* If this is the first unacked packet, start the timer */
-    if (oldest_unacked == -1)
+    if (s->oldest_unacked == -1)
     {
-      oldest_unacked = A_nextseqnum;
-      starttimer(A, RTT);
+      s->oldest_unacked = s->A_nextseqnum;
+      starttimer(A, racktimeout(&s->rack, &s->rto));
     }
 
     /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    s->A_nextseqnum = (s->A_nextseqnum + 1) % SEQSPACE;
   }
   /* if blocked,  window is full */
   else
   {
     if (TRACE > 0)
       printf("----A: New message arrives, send window is full\n");
-    window_full++;
+    connstats->window_full++;
+  }
+}
+
+/* resend the packets awaiting an ACK that rack takes for lost after an ACK */
+static void A_racklost(struct sender *s)
+{
+  int i, seq, index;
+
+  for (i = 0; i < s->windowcount; i++)
+  {
+    seq = (s->windowbase + i) % SEQSPACE;
+    index = seq % WINDOWSIZE;
+    if (!(s->acked & BIT(index)) && (s->in_window & BIT(seq)) && racklost(&s->rack, index))
+    {
+      if (TRACE > 0)
+        printf("---A: packet %d is lost, resending it\n", seq);
+      tolayer3(A, ((struct pkt *)slabptr(s->buffer))[index]);
+      connstats->packets_resent++;
+      racksent(&s->rack, index, 1);
+      if (seq == s->rto.seq)
+        s->rto.seq = -1; /* its ACK will not tell which one got through */
+      ccmarked(&s->cw);
+    }
   }
 }
 
 /* called from layer 3, when a packet arrives for layer 4
    In this practical this will always be an ACK as B never sends data.
 */
-void A_input(struct pkt packet)
+static void A_input(struct pkt packet)
 {
-  int index;
+  struct sender *s = Astate;
+  unsigned int newly;
+  int index, n;
 
   /* if received ACK is not corrupted */
   if (!IsCorrupted(packet))
   {
     if (TRACE > 0)
       printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
-    total_ACKs_received++;
+    connstats->total_ACKs_received++;
+    if (packet.flags & ECE)
+      ccmarked(&s->cw);
+
+    /* the ACK is for one packet, and also says B has every packet
+       before its window base */
+    newly = 0;
+    n = (packet.seqnum - s->windowbase + SEQSPACE) % SEQSPACE;
+    if (n <= s->windowcount)
+      newly = SLOTS(n, s->windowbase % WINDOWSIZE);
 
     /* check if ACK is within current window */
-    if (((windowbase <= (windowbase + windowcount - 1) % SEQSPACE) &&
-         (packet.acknum >= windowbase && packet.acknum <= (windowbase + windowcount - 1) % SEQSPACE)) ||
-        ((windowbase > (windowbase + windowcount - 1) % SEQSPACE) &&
-         (packet.acknum >= windowbase || packet.acknum <= (windowbase + windowcount - 1) % SEQSPACE)))
+    if (((s->windowbase <= (s->windowbase + s->windowcount - 1) % SEQSPACE) &&
+         (packet.acknum >= s->windowbase && packet.acknum <= (s->windowbase + s->windowcount - 1) % SEQSPACE)) ||
+        ((s->windowbase > (s->windowbase + s->windowcount - 1) % SEQSPACE) &&
+         (packet.acknum >= s->windowbase || packet.acknum <= (s->windowbase + s->windowcount - 1) % SEQSPACE)))
     {
-      index = packet.acknum % WINDOWSIZE;
+      if (s->in_window & BIT(packet.acknum))
+        newly |= BIT(packet.acknum % WINDOWSIZE);
+    }
+    else if (TRACE > 0)
+      printf("----A: ACK %d outside window\n", packet.acknum);
 
-      /* Only process if not already ACKed */
-      if (!acked[index] && in_window[packet.acknum])
+    /* Only process if not already ACKed */
+    newly &= ~s->acked;
+    if (newly != 0)
+    {
+      if (TRACE > 0)
+        printf("----A: ACK %d, window base %d at B, is not a duplicate\n", packet.acknum, packet.seqnum);
+      connstats->new_ACKs++;
+
+      /* mark as ACKed */
+      s->acked |= newly;
+      ccacked(&s->cw, count(newly));
+      if (s->rto.seq != -1 && (s->rto.seq - s->windowbase + SEQSPACE) % SEQSPACE < s->windowcount &&
+          (newly & BIT(s->rto.seq % WINDOWSIZE)))
+        rtoacked(&s->rto);
+      for (index = 0; index < WINDOWSIZE; index++)
+        if (newly & BIT(index))
+          rackacked(&s->rack, index);
+      A_racklost(s);
+
+      /* If this was the packet we were timing, stop timer and find next to time;
+         with rack any new ACK puts off the probe */
+      if ((s->oldest_unacked != -1 && (newly & BIT(s->oldest_unacked % WINDOWSIZE))) || rack)
       {
-        if (TRACE > 0)
-          printf("----A: ACK %d is not a duplicate\n", packet.acknum);
-        new_ACKs++;
-
-        /* mark as ACKed */
-        acked[index] = true;
+        stoptimer(A);
+        find_oldest_unacked(s);
 
-        /* If this was the packet we were timing, stop timer and find next to time */
-        if (packet.acknum == oldest_unacked)
+        /* If there are still unacked packets, restart timer */
+        if (s->oldest_unacked != -1)
         {
-          stoptimer(A);
-          find_oldest_unacked();
-
-          /* If there are still unacked packets, restart timer */
-          if (oldest_unacked != -1)
-          {
-            starttimer(A, RTT);
-          }
+          starttimer(A, racktimeout(&s->rack, &s->rto));
         }
+      }
 
-        /* Slide window if base packet is ACKed */
-        while (windowcount > 0 && acked[windowbase % WINDOWSIZE] && in_window[windowbase])
-        {
-          in_window[windowbase] = false; // Mark as no longer in window
-          windowbase = (windowbase + 1) % SEQSPACE;
-          windowcount--;
-        }
+      /* Slide window if base packet is ACKed */
+      while (s->windowcount > 0 && (s->acked & BIT(s->windowbase % WINDOWSIZE)) && (s->in_window & BIT(s->windowbase)))
+      {
+        s->in_window &= ~BIT(s->windowbase); // Mark as no longer in window
+        s->windowbase = (s->windowbase + 1) % SEQSPACE;
+        s->windowcount--;
       }
-      else
+
+      /* Give the buffer back to the pool once everything is ACKed */
+      if (s->windowcount == 0)
       {
-        if (TRACE > 0)
-          printf("----A: duplicate ACK %d, do nothing!\n", packet.acknum);
+        slabput(s->buffer, BUFFERSIZE);
+        s->buffer = 0;
+        rackfree(&s->rack);
       }
     }
     else
     {
       if (TRACE > 0)
-        printf("----A: ACK %d outside window, do nothing!\n", packet.acknum);
+        printf("----A: duplicate ACK %d, do nothing!\n", packet.acknum);
     }
   }
   else
@@ -207,36 +296,59 @@ void A_input(struct pkt packet)
 }
 
 /* called when A's timer goes off */
-void A_timerinterrupt(void)
+static void A_timerinterrupt(void)
 {
-  int index;
+  struct sender *s = Astate;
+  int index, i, seq;
 
-  if (oldest_unacked != -1)
+  if (s->oldest_unacked != -1 && rackexpired(&s->rack))
   {
-    index = oldest_unacked % WINDOWSIZE;
+    /* tail loss probe: resend the last packet sent */
+    for (i = s->windowcount - 1; i > 0; i--)
+    {
+      seq = (s->windowbase + i) % SEQSPACE;
+      if (!(s->acked & BIT(seq % WINDOWSIZE)) && (s->in_window & BIT(seq)))
+        break;
+    }
+    seq = (s->windowbase + i) % SEQSPACE;
+    if (TRACE > 0)
+      printf("---A: probe, resending packet %d\n", seq);
+    tolayer3(A, ((struct pkt *)slabptr(s->buffer))[seq % WINDOWSIZE]);
+    connstats->packets_resent++;
+    racksent(&s->rack, seq % WINDOWSIZE, 1);
+    if (seq == s->rto.seq)
+      s->rto.seq = -1;
+    starttimer(A, racktimeout(&s->rack, &s->rto));
+  }
+  else if (s->oldest_unacked != -1)
+  {
+    index = s->oldest_unacked % WINDOWSIZE;
 
     if (TRACE > 0)
       printf("----A: time out,resend packets!\n");
+    rtoexpired(&s->rto);
+    cctimeout(&s->cw);
 
     /* Only resend if still within window and not yet ACKed */
-    if (!acked[index] && in_window[oldest_unacked])
+    if (!(s->acked & BIT(index)) && (s->in_window & BIT(s->oldest_unacked)))
     {
       /* resend just this packet */
       if (TRACE > 0)
-        printf("---A: resending packet %d\n", oldest_unacked);
+        printf("---A: resending packet %d\n", s->oldest_unacked);
 
-      tolayer3(A, buffer[index]);
-      packets_resent++;
+      tolayer3(A, ((struct pkt *)slabptr(s->buffer))[index]);
+      connstats->packets_resent++;
+      racksent(&s->rack, index, 1);
 
-      starttimer(A, RTT);
+      starttimer(A, racktimeout(&s->rack, &s->rto));
     }
     else
     {
       /* This packet is already ACKed, find next one to time */
-      find_oldest_unacked();
-      if (oldest_unacked != -1)
+      find_oldest_unacked(s);
+      if (s->oldest_unacked != -1)
       {
-        starttimer(A, RTT);
+        starttimer(A, racktimeout(&s->rack, &s->rto));
       }
     }
   }
@@ -244,38 +356,39 @@ void A_timerinterrupt(void)
 
 /* the following routine will be called once (only) before any other */
 /* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+static void A_init(void)
 {
   /* initialise A's window, buffer and sequence number */
-  int i;
-  A_nextseqnum = 0; /* A starts with seq num 0, do not change this */
-  windowcount = 0;
-  windowbase = 0;
-  oldest_unacked = -1;
-
-  for (i = 0; i < WINDOWSIZE; i++)
-  {
-    acked[i] = false;
-  }
-
-  for (i = 0; i < SEQSPACE; i++)
-  {
-    in_window[i] = false;
-  }
+  struct sender *s = Astate;
+  s->A_nextseqnum = 0; /* A starts with seq num 0, do not change this */
+  s->windowcount = 0;
+  s->windowbase = 0;
+  s->oldest_unacked = -1;
+  s->buffer = 0; /* no buffer until there is something to send */
+  s->acked = 0;
+  s->in_window = 0;
+  s->rack = 0;
+  rtoinit(&s->rto, rto_initial > 0 ? rto_initial : RTT, adaptive_rto);
+  ccinit(&s->cw, window_limit > 0 && window_limit < WINDOWSIZE ? window_limit : WINDOWSIZE, congestion_control);
 }
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum;                 /* the sequence number expected next by the receiver */
-static int B_nextseqnum;                   /* the sequence number for the next packets sent by B */
-static struct pkt recv_buffer[WINDOWSIZE]; /* buffer for out-of-order packets */
-static bool received[WINDOWSIZE];          /* indicates whether packet is received in window */
-static int B_windowbase;                   /* base of the receiver window */
-static bool already_received[SEQSPACE];    /* track which packets have been received already */
+/* State variables for receiver, one set per connection found through Bstate */
+struct receiver
+{
+  slabref recv_buffer;             /* buffer for out-of-order packets, while there are any */
+  unsigned short received;         /* indicates whether packet is received in window, per slot */
+  unsigned short already_received; /* track which packets have been received already */
+  unsigned char expectedseqnum;    /* the sequence number expected next by the receiver */
+  unsigned char B_windowbase;      /* base of the receiver window */
+};
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+static void B_input(struct pkt packet)
 {
+  struct receiver *r = Bstate;
+  struct pkt *recv_buffer;
   struct pkt sendpkt;
   int i;
   int index;
@@ -287,42 +400,52 @@ void B_input(struct pkt packet)
       printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
 
     /* Count ALL correctly received packets (even duplicates) */
-    packets_received++;
+    connstats->packets_received++;
 
     /* Check if packet falls within the receive window */
-    if (((B_windowbase <= (B_windowbase + WINDOWSIZE - 1) % SEQSPACE) &&
-         (packet.seqnum >= B_windowbase && packet.seqnum <= (B_windowbase + WINDOWSIZE - 1) % SEQSPACE)) ||
-        ((B_windowbase > (B_windowbase + WINDOWSIZE - 1) % SEQSPACE) &&
-         (packet.seqnum >= B_windowbase || packet.seqnum <= (B_windowbase + WINDOWSIZE - 1) % SEQSPACE)))
+    if (((r->B_windowbase <= (r->B_windowbase + WINDOWSIZE - 1) % SEQSPACE) &&
+         (packet.seqnum >= r->B_windowbase && packet.seqnum <= (r->B_windowbase + WINDOWSIZE - 1) % SEQSPACE)) ||
+        ((r->B_windowbase > (r->B_windowbase + WINDOWSIZE - 1) % SEQSPACE) &&
+         (packet.seqnum >= r->B_windowbase || packet.seqnum <= (r->B_windowbase + WINDOWSIZE - 1) % SEQSPACE)))
     {
 
       /* Store packet in the buffer if not already received */
       index = packet.seqnum % WINDOWSIZE;
-      if (!received[index])
+      if (!(r->received & BIT(index)))
       {
-        received[index] = true;
+        /* The buffer is taken from the pool while it holds any packet */
+        if (r->received == 0)
+          r->recv_buffer = slabget(BUFFERSIZE);
+        recv_buffer = slabptr(r->recv_buffer);
+        r->received |= BIT(index);
         recv_buffer[index] = packet;
 
         /* Track which packets have been delivered to app layer */
-        if (!already_received[packet.seqnum])
+        if (!(r->already_received & BIT(packet.seqnum)))
         {
-          already_received[packet.seqnum] = true;
+          r->already_received |= BIT(packet.seqnum);
         }
 
         /* If this is the base of the window, deliver it and any consecutive buffered packets */
-        if (packet.seqnum == B_windowbase)
+        if (packet.seqnum == r->B_windowbase)
         {
           do
           {
             /* Deliver to application layer */
-            tolayer5(B, recv_buffer[B_windowbase % WINDOWSIZE].payload);
+            tolayer5(B, recv_buffer[r->B_windowbase % WINDOWSIZE].payload);
 
             /* Mark as not received since it's been delivered */
-            received[B_windowbase % WINDOWSIZE] = false;
+            r->received &= ~BIT(r->B_windowbase % WINDOWSIZE);
 
             /* Move window base forward */
-            B_windowbase = (B_windowbase + 1) % SEQSPACE;
-          } while (received[B_windowbase % WINDOWSIZE]);
+            r->B_windowbase = (r->B_windowbase + 1) % SEQSPACE;
+          } while (r->received & BIT(r->B_windowbase % WINDOWSIZE));
+
+          if (r->received == 0)
+          {
+            slabput(r->recv_buffer, BUFFERSIZE);
+            r->recv_buffer = 0;
+          }
         }
       }
 
@@ -332,22 +455,20 @@ void B_input(struct pkt packet)
     else
     {
       /* Packet outside window - must be a duplicate from below the window */
-      if (TRACE > 0)
-        /*printf("----B: packet %d outside window, send ACK anyway\n", packet.seqnum);*/
-        sendpkt.acknum = packet.seqnum;
+      /*printf("----B: packet %d outside window, send ACK anyway\n", packet.seqnum);*/
+      sendpkt.acknum = packet.seqnum;
     }
   }
   else
   {
     /* Packet is corrupted, do not send ACK */
-    if (TRACE > 0)
-      /*printf("----B: packet corrupted, do not send ACK\n");*/
-      return;
+    /*printf("----B: packet corrupted, do not send ACK\n");*/
+    return;
   }
 
-  /* Create ACK packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2; /* Alternating bit for ACK seqnum */
+  /* Create ACK packet, echoing a congestion mark */
+  sendpkt.seqnum = r->B_windowbase; /* cumulative: B has every packet before it */
+  sendpkt.flags = (packet.flags & CE) ? ECE : 0;
 
   /* Fill payload with 0's - no data in ACKs */
   for (i = 0; i < 20; i++)
@@ -360,21 +481,14 @@ void B_input(struct pkt packet)
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+static void B_init(void)
 {
-  int i;
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
-  B_windowbase = 0;
-
-  for (i = 0; i < WINDOWSIZE; i++)
-  {
-    received[i] = false;
-  }
-  for (i = 0; i < SEQSPACE; i++)
-  {
-    already_received[i] = false;
-  }
+  struct receiver *r = Bstate;
+  r->expectedseqnum = 0;
+  r->B_windowbase = 0;
+  r->recv_buffer = 0;
+  r->received = 0;
+  r->already_received = 0;
 }
 
 /******************************************************************************
@@ -382,11 +496,14 @@ void B_init(void)
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+static void B_output(struct msg message)
 {
 }
 
 /* called when B's timer goes off */
-void B_timerinterrupt(void)
+static void B_timerinterrupt(void)
 {
-}
\ No newline at end of file
+}
+const struct protocol sr_protocol = {
+    "sr", sizeof(struct sender), sizeof(struct receiver), WINDOWSIZE, RTT, SELECTIVE, 0,
+    A_init, B_init, A_input, B_input, A_output, B_output, A_timerinterrupt, B_timerinterrupt, NULL, NULL};
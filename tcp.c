@@ -0,0 +1,452 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "slab.h"
+#include "rto.h"
+#include "cc.h"
+#include "tcp.h"
+
+/* ******************************************************************
+   TCP NewReno style protocol, on the emulator of J.F.Kurose
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2
+
+   Network properties:
+   - one way network delay averages five time units (longer if there
+   are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+   or lost, according to user-defined probabilities
+   - packets will be delivered in the order in which they were sent
+   (although some can be lost).
+
+   Protocol:
+   - cumulative ACKs that name the next packet expected, with a SACK
+   bitmap of the packets B holds beyond it in the otherwise unused
+   sequence number field of the ACK.
+   - B buffers packets that arrive out of order, as in SR.
+   - DUPACKS duplicate ACKs make a fast retransmit and start fast
+   recovery, which lasts until every packet sent before it is ACKed.  A
+   partial ACK in it resends the next packet at once (NewReno), and the
+   holes SACK shows are resent as the packets in flight allow.
+   - the timeout is always adaptive and the congestion window always in
+   use, whatever -r and -C say.  Packets in flight are those awaiting
+   an ACK less those SACKed or taken for lost, and are kept within the
+   congestion window.
+**********************************************************************/
+
+#define RTT 16.0      /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#define WINDOWSIZE 8  /* the maximum number of buffered unacked packet */
+#define SEQSPACE 16   /* at least 2 * windowsize, as B buffers out of order packets */
+#define DUPACKS 3     /* duplicate ACKs that are taken for a loss */
+#define NOTINUSE (-1) /* used to fill header fields that are not being used */
+
+#define BUFFERSIZE (WINDOWSIZE * sizeof(struct pkt))
+#define BIT(n) (1u << (n)) /* packets are kept in bitmaps by their distance from the first awaiting an ACK */
+#define BELOW(n) (BIT(n) - 1)
+
+/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
+   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
+   original checksum.  This procedure must generate a different checksum to the original if
+   the packet is corrupted.
+*/
+static int ComputeChecksum(struct pkt packet)
+{
+  int checksum = 0;
+  int i;
+
+  checksum = packet.seqnum;
+  checksum += packet.acknum;
+  for (i = 0; i < 20; i++)
+    checksum += (int)(packet.payload[i]);
+
+  return checksum;
+}
+
+static bool IsCorrupted(struct pkt packet)
+{
+  if (packet.checksum == ComputeChecksum(packet))
+    return (false);
+  else
+    return (true);
+}
+
+static int count(unsigned int bits)
+{
+  int n = 0;
+
+  for (; bits != 0; bits &= bits - 1)
+    n++;
+  return n;
+}
+
+/********* Sender (A) variables and functions ************/
+
+/* sender state of one connection, found through Astate */
+struct sender
+{
+  slabref buffer;          /* packets awaiting an ACK by sequence number % WINDOWSIZE, while there are any */
+  unsigned char base;      /* sequence number of the first packet awaiting an ACK */
+  unsigned char nextseq;   /* sequence number of the next new packet */
+  unsigned char windowcount; /* the number of packets currently awaiting an ACK */
+  unsigned char dupacks;   /* duplicate ACKs in a row */
+  unsigned char recover;   /* in fast recovery: the sequence number sent next when it started */
+  bool inrecovery;
+  unsigned short sacked;   /* packets B holds, by distance from base */
+  unsigned short lost;     /* packets taken for lost and not resent yet */
+  unsigned short resent;   /* packets resent since the last loss was found */
+  struct rto rto;          /* retransmission timeout */
+  struct cwnd cw;          /* congestion window */
+};
+
+/* packets in the network */
+static int inflight(struct sender *s)
+{
+  return s->windowcount - count(s->sacked) - count(s->lost);
+}
+
+/* take in the SACK bitmap of an ACK, by distance from the packet after
+   base: packets B holds are neither lost nor waiting to be resent */
+static void A_sack(struct sender *s, int sack)
+{
+  s->sacked = (sack << 1) & BELOW(s->windowcount);
+  s->lost &= ~s->sacked;
+  s->resent &= ~s->sacked;
+}
+
+/* the packets below the last one SACKed that B does not have */
+static unsigned int holes(struct sender *s)
+{
+  unsigned int below = 0;
+  int i;
+
+  for (i = 0; i < s->windowcount; i++)
+    if (s->sacked & BIT(i))
+      below = BELOW(i);
+  return below & ~s->sacked;
+}
+
+/* resend the packet i from base */
+static void A_resendpacket(struct sender *s, int i)
+{
+  struct pkt *buffer = slabptr(s->buffer);
+  int seq = (s->base + i) % SEQSPACE;
+
+  if (TRACE > 0)
+    printf("---A: resending packet %d\n", seq);
+  tolayer3(A, buffer[seq % WINDOWSIZE]);
+  connstats->packets_resent++;
+  s->lost &= ~BIT(i);
+  s->resent |= BIT(i);
+  if (s->rto.seq == seq)
+    s->rto.seq = -1; /* its ACK will not tell which one got through */
+}
+
+/* resend packets taken for lost, oldest first, while the window has room */
+static void A_resend(struct sender *s)
+{
+  int i;
+
+  for (i = 0; s->lost != 0 && inflight(s) < ccwindow(&s->cw); i++)
+    if (s->lost & BIT(i))
+      A_resendpacket(s, i);
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void A_output(struct msg message)
+{
+  struct sender *s = Astate;
+  struct pkt *buffer;
+  struct pkt sendpkt;
+  int i;
+
+  /* if not blocked waiting on ACK */
+  if (s->windowcount < WINDOWSIZE && inflight(s) < ccwindow(&s->cw))
+  {
+    if (TRACE > 1)
+      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
+
+    /* create packet */
+    sendpkt.seqnum = s->nextseq;
+    sendpkt.acknum = NOTINUSE;
+    for (i = 0; i < 20; i++)
+      sendpkt.payload[i] = message.data[i];
+    sendpkt.flags = ecn ? ECT : 0;
+    sendpkt.checksum = ComputeChecksum(sendpkt);
+
+    /* put packet in window buffer, taken from the pool for the first one */
+    if (s->windowcount == 0)
+      s->buffer = slabget(BUFFERSIZE);
+    buffer = slabptr(s->buffer);
+    buffer[s->nextseq % WINDOWSIZE] = sendpkt;
+    s->windowcount++;
+
+    /* send out packet */
+    if (TRACE > 0)
+      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+    tolayer3(A, sendpkt);
+    rtosent(&s->rto, sendpkt.seqnum);
+
+    /* start timer if first packet in window */
+    if (s->windowcount == 1)
+      starttimer(A, rtotimeout(&s->rto));
+
+    s->nextseq = (s->nextseq + 1) % SEQSPACE;
+  }
+  /* if blocked,  window is full */
+  else
+  {
+    if (TRACE > 0)
+      printf("----A: New message arrives, send window is full\n");
+    connstats->window_full++;
+  }
+}
+
+/* a duplicate ACK: after DUPACKS of them the first packet and the holes
+   are taken for lost, and fast recovery starts */
+static void A_dupack(struct sender *s)
+{
+  s->dupacks++;
+  if (!s->inrecovery && s->dupacks >= DUPACKS)
+  {
+    if (TRACE > 0)
+      printf("----A: %d duplicate ACKs, fast retransmit!\n", s->dupacks);
+    s->inrecovery = true;
+    s->recover = s->nextseq;
+    s->resent = 0;
+    s->lost = holes(s);
+    cchalve(&s->cw);
+    A_resendpacket(s, 0); /* whatever the window */
+  }
+  else if (s->inrecovery)
+    s->lost |= holes(s) & ~s->resent;
+}
+
+/* a new ACK of n packets, with the given SACK bitmap: slide the window
+   past them */
+static void A_newack(struct sender *s, int n, int sack)
+{
+  int full = (s->recover - s->base + SEQSPACE) % SEQSPACE <= n;
+
+  connstats->new_ACKs++;
+
+  /* take a round trip sample if the packet being timed is among them */
+  if (s->rto.seq != -1 && (s->rto.seq - s->base + SEQSPACE) % SEQSPACE < n)
+    rtoacked(&s->rto);
+
+  s->base = (s->base + n) % SEQSPACE;
+  s->windowcount -= n;
+  s->lost >>= n;
+  s->resent >>= n;
+  A_sack(s, sack);
+  s->dupacks = 0;
+  if (!s->inrecovery)
+    ccacked(&s->cw, n);
+  else if (full)
+  {
+    if (TRACE > 0)
+      printf("----A: fast recovery is over\n");
+    s->inrecovery = false;
+    s->lost = 0;
+    s->resent = 0;
+  }
+  else
+  { /* partial ACK: the next packet is lost too, and resent at once */
+    s->lost |= holes(s) & ~s->resent;
+    A_resendpacket(s, 0);
+  }
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   In this practical this will always be an ACK as B never sends data.
+*/
+static void A_input(struct pkt packet)
+{
+  struct sender *s = Astate;
+  int n;
+
+  /* if received ACK is not corrupted */
+  if (IsCorrupted(packet))
+  {
+    if (TRACE > 0)
+      printf("----A: corrupted ACK is received, do nothing!\n");
+    return;
+  }
+  if (TRACE > 0)
+    printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
+  connstats->total_ACKs_received++;
+
+  n = (packet.acknum - s->base + SEQSPACE) % SEQSPACE;
+  if (s->windowcount == 0 || n > s->windowcount)
+  {
+    if (TRACE > 0)
+      printf("----A: old ACK received, do nothing!\n");
+    return;
+  }
+  if ((packet.flags & ECE) && !s->inrecovery)
+    ccmarked(&s->cw);
+  if (n == 0)
+  {
+    if (TRACE > 0)
+      printf("----A: duplicate ACK received\n");
+    A_sack(s, packet.seqnum);
+    A_dupack(s);
+    A_resend(s);
+    return;
+  }
+  if (TRACE > 0)
+    printf("----A: ACK %d is not a duplicate\n", packet.acknum);
+  A_newack(s, n, packet.seqnum);
+  A_resend(s);
+
+  /* start timer again if there are still more unacked packets in window */
+  stoptimer(A);
+  if (s->windowcount > 0)
+    starttimer(A, rtotimeout(&s->rto));
+  else
+  {
+    /* nothing left to resend, give the buffer back to the pool */
+    slabput(s->buffer, BUFFERSIZE);
+    s->buffer = 0;
+  }
+}
+
+/* called when A's timer goes off */
+static void A_timerinterrupt(void)
+{
+  struct sender *s = Astate;
+
+  if (TRACE > 0)
+    printf("----A: time out,resend packets!\n");
+  rtoexpired(&s->rto);
+  cctimeout(&s->cw);
+
+  /* every packet B does not hold is taken for lost, and resent as the
+     window opens again */
+  s->inrecovery = false;
+  s->dupacks = 0;
+  s->resent = 0;
+  s->lost = BELOW(s->windowcount) & ~s->sacked;
+  A_resend(s);
+  if (s->windowcount > 0)
+    starttimer(A, rtotimeout(&s->rto));
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+static void A_init(void)
+{
+  struct sender *s = Astate;
+
+  s->base = 0; /* A starts with seq num 0, do not change this */
+  s->nextseq = 0;
+  s->windowcount = 0;
+  s->dupacks = 0;
+  s->inrecovery = false;
+  s->sacked = s->lost = s->resent = 0;
+  s->buffer = 0; /* no buffer until there is something to send */
+  rtoinit(&s->rto, rto_initial > 0 ? rto_initial : RTT, 1);
+  ccinit(&s->cw, window_limit > 0 && window_limit < WINDOWSIZE ? window_limit : WINDOWSIZE, 1);
+}
+
+/********* Receiver (B)  variables and procedures ************/
+
+/* receiver state of one connection, found through Bstate */
+struct receiver
+{
+  slabref buffer;               /* packets out of order by sequence number % WINDOWSIZE, while there are any */
+  unsigned char expectedseqnum; /* the sequence number expected next by the receiver */
+  unsigned short received;      /* packets held, by distance from it */
+};
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+static void B_input(struct pkt packet)
+{
+  struct receiver *r = Bstate;
+  struct pkt *buffer;
+  struct pkt sendpkt;
+  int i, d;
+
+  d = (packet.seqnum - r->expectedseqnum + SEQSPACE) % SEQSPACE;
+
+  /* if not corrupted and in the receive window, and not held already */
+  if (!IsCorrupted(packet) && d < WINDOWSIZE && !(r->received & BIT(d)))
+  {
+    if (TRACE > 0)
+      printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
+    connstats->packets_received++;
+
+    if (d > 0)
+    { /* hold it until the packets before it are in */
+      if (r->received == 0)
+        r->buffer = slabget(BUFFERSIZE);
+      buffer = slabptr(r->buffer);
+      buffer[packet.seqnum % WINDOWSIZE] = packet;
+      r->received |= BIT(d);
+    }
+    else
+    {
+      /* deliver it and the packets held after it to receiving application */
+      tolayer5(B, packet.payload);
+      r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+      r->received >>= 1;
+      while (r->received & BIT(0))
+      {
+        buffer = slabptr(r->buffer);
+        tolayer5(B, buffer[r->expectedseqnum % WINDOWSIZE].payload);
+        r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+        r->received >>= 1;
+      }
+      if (r->received == 0 && r->buffer != 0)
+      {
+        slabput(r->buffer, BUFFERSIZE);
+        r->buffer = 0;
+      }
+    }
+  }
+  else if (TRACE > 0)
+    printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
+
+  /* ACK the next packet expected, and SACK those held beyond it */
+  sendpkt.acknum = r->expectedseqnum;
+  sendpkt.seqnum = r->received >> 1;
+  sendpkt.flags = (packet.flags & CE) ? ECE : 0;
+
+  /* we don't have any data to send.  fill payload with 0's */
+  for (i = 0; i < 20; i++)
+    sendpkt.payload[i] = '0';
+
+  /* computer checksum */
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+
+  /* send out packet */
+  tolayer3(B, sendpkt);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+static void B_init(void)
+{
+  struct receiver *r = Bstate;
+
+  r->expectedseqnum = 0;
+  r->received = 0;
+  r->buffer = 0;
+}
+
+/******************************************************************************
+ * The following functions need be completed only for bi-directional messages *
+ *****************************************************************************/
+
+/* Note that with simplex transfer from a-to-B, there is no B_output() */
+static void B_output(struct msg message)
+{
+}
+
+/* called when B's timer goes off */
+static void B_timerinterrupt(void)
+{
+}
+
+const struct protocol tcp_protocol = {
+    "tcp", sizeof(struct sender), sizeof(struct receiver), WINDOWSIZE, RTT, SELECTIVE, 1,
+    A_init, B_init, A_input, B_input, A_output, B_output, A_timerinterrupt, B_timerinterrupt, NULL, NULL};
@@ -0,0 +1,2 @@
+/* TCP NewReno style protocol entities */
+extern const struct protocol tcp_protocol;